@@ -24,6 +24,10 @@
 
 #pragma link C++ namespace     pueo::Locations;
 #pragma link C++ namespace     pueo::version;
+#pragma link C++ namespace     pueo::triggerbits;
+#pragma link C++ function      pueo::triggerbits::triggeredPhis;
+#pragma link C++ function      pueo::triggerbits::excludedPhis;
+#pragma link C++ function      pueo::triggerbits::usablePhis;
 
 
 #pragma link C++ class pueo::GeomTool-;
@@ -31,6 +35,17 @@
 #pragma link C++ class pueo::Dataset+;
 #pragma link C++ class pueo::TruthEvent+;
 #pragma link C++ class pueo::UsefulEvent+;
+#pragma link C++ class pueo::CompactUsefulEvent+;
+#pragma link C++ class pueo::EventGraphs-;
+#ifdef HAVE_FFTW
+#pragma link C++ class pueo::FFT-;
+#pragma link C++ class pueo::CorrelationCache-;
+#pragma link C++ class pueo::PowerSpectra-;
+#pragma link C++ class pueo::AverageSpectrum-;
+#pragma link C++ class pueo::SkyMapConfig+;
+#pragma link C++ class pueo::SkyMap+;
+#pragma link C++ class pueo::SkyMapper-;
+#endif
 #pragma link C++ class pueo::RawHeader+;
 #pragma link C++ namespace pueo::nav;
 #pragma link C++ class pueo::nav::Position+;
@@ -39,12 +54,32 @@
 #pragma link C++ class pueo::nav::Sats+;
 #pragma link C++ class pueo::nav::SunSensor+;
 #pragma link C++ class pueo::nav::SunSensors+;
+#pragma link C++ class pueo::nav::Quaternion+;
+#pragma link C++ class pueo::nav::AttitudeFrame+;
+#pragma link C++ class pueo::nav::RotationCache-;
+#pragma link C++ enum pueo::nav::frame_t;
+#pragma link C++ function pueo::nav::anglesToVectors;
+#pragma link C++ function pueo::nav::vectorsToAngles;
 
 #pragma link C++ class pueo::hsk::Sensor+;
+#pragma link C++ class pueo::hsk::SensorInfo+;
+#pragma link C++ class pueo::hsk::Reading+;
+#pragma link C++ class pueo::hsk::SensorTable-;
+#pragma link C++ class pueo::hsk::Point+;
+#pragma link C++ class pueo::hsk::EnvelopeBin+;
+#pragma link C++ class pueo::hsk::SeriesReader-;
 #pragma link C++ class pueo::daqhsk::DaqHsk+;
 #pragma link C++ class pueo::daqhsk::Surf+;
 #pragma link C++ class pueo::daqhsk::Beam+;
 #pragma link C++ class pueo::Timemark+;
+#pragma link C++ class pueo::BeamConfig+;
+#pragma link C++ class pueo::BeamResult+;
+#pragma link C++ class pueo::BeamEmulator-;
+#pragma link C++ class pueo::ElevationModel-;
+#pragma link C++ class pueo::ConstantElevation-;
+#pragma link C++ class pueo::TiledElevation-;
+#pragma link C++ class pueo::GroundPoint+;
+#pragma link C++ class pueo::GroundProjector-;
 
 #pragma read \
   targetClass = "pueo::RawEvent"\
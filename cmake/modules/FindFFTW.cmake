@@ -0,0 +1,30 @@
+# File: FindFFTW.cmake
+# Purpose: Finds the double-precision FFTW3 library, setting FFTW_FOUND and providing the
+#          imported target FFTW::fftw3. Uses pkg-config if available, otherwise searches
+#          the usual places (and $FFTW_DIR / $FFTWDIR if set).
+
+find_package(PkgConfig QUIET)
+if(PKG_CONFIG_FOUND)
+  pkg_check_modules(PC_FFTW QUIET fftw3)
+endif()
+
+find_path(FFTW_INCLUDE_DIR fftw3.h
+  HINTS ${PC_FFTW_INCLUDE_DIRS} $ENV{FFTW_DIR}/include $ENV{FFTWDIR}/include
+)
+
+find_library(FFTW_LIBRARY NAMES fftw3
+  HINTS ${PC_FFTW_LIBRARY_DIRS} $ENV{FFTW_DIR}/lib $ENV{FFTWDIR}/lib
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(FFTW REQUIRED_VARS FFTW_LIBRARY FFTW_INCLUDE_DIR)
+
+if(FFTW_FOUND AND NOT TARGET FFTW::fftw3)
+  add_library(FFTW::fftw3 UNKNOWN IMPORTED)
+  set_target_properties(FFTW::fftw3 PROPERTIES
+    IMPORTED_LOCATION "${FFTW_LIBRARY}"
+    INTERFACE_INCLUDE_DIRECTORIES "${FFTW_INCLUDE_DIR}"
+  )
+endif()
+
+mark_as_advanced(FFTW_INCLUDE_DIR FFTW_LIBRARY)
@@ -13,5 +13,5 @@ EXTRA_ARG="$@"
 
 mkdir -p $OUTDIR
 
-pueo-convert header $OUTDIR/headFile$RUN.root $INDIR/  "$EXTRA_ARG"
-pueo-convert event $OUTDIR/eventFile$RUN.root $INDIR/ "$EXTRA_ARG"
+# headers and events come from the same raw files, so make both in one pass
+pueo-convert header,event $OUTDIR/headFile$RUN.root,$OUTDIR/eventFile$RUN.root $INDIR/ "$EXTRA_ARG"
@@ -0,0 +1,23 @@
+#! /bin/sh
+
+# Feeds a raw run directory into another directory file by file, as if it were
+# being written, e.g. for trying out pueo-convert --watch on a laptop.
+# Files are copied under a hidden name and moved into place, so each appears complete.
+
+if [ "$#" -lt 2 ]; then
+  echo "Usage:  pueo-replay-run rawrundir destdir [seconds between files]"
+  exit 1;
+fi
+
+SRC=$1
+DEST=$2/`basename $SRC`
+DELAY=${3:-1}
+
+mkdir -p $DEST
+
+for f in `ls $SRC`; do
+  cp $SRC/$f $DEST/.$f.tmp
+  mv $DEST/.$f.tmp $DEST/$f
+  echo $DEST/$f
+  sleep $DELAY
+done
@@ -0,0 +1,135 @@
+/****************************************************************************************
+*  BeamEmulator.cc            Software replay of the SURF beamforming trigger
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/BeamEmulator.h"
+#include "pueo/RawEvent.h"
+#include "pueo/DaqHsk.h"
+#include "pueo/Dataset.h"
+#include "pueo/GeomTool.h"
+#include "kernels.h"
+#include "parallel.h"
+
+#include "TMath.h"
+
+#include <cmath>
+#include <vector>
+
+
+static const double C_M_PER_NS = 0.299792458;
+static const double NOMINAL_SAMPLES_PER_NS = 3;
+
+
+pueo::BeamConfig::BeamConfig()
+{
+  for (auto & surf : delays)
+  {
+    for (auto & beam : surf) beam.fill(0);
+  }
+}
+
+
+pueo::BeamConfig pueo::BeamConfig::fromGeometry(double el_min, double el_max, const GeomTool * geom)
+{
+  if (!geom) geom = &GeomTool::Instance(0, "flight");
+
+  BeamConfig cfg;
+  for (int surf = 0; surf < k::NUM_SURF_SLOTS; surf++)
+  {
+    std::array<double, k::NUM_CHANS_PER_SURF> z;
+    std::array<bool, k::NUM_CHANS_PER_SURF> have;
+    for (int chan = 0; chan < k::NUM_CHANS_PER_SURF; chan++)
+    {
+      Int_t ant;
+      pol::pol_t pol;
+      have[chan] = geom->getAntPolFromSurfChan(surf, chan, ant, pol) >= 0;
+      z[chan] = have[chan] ? geom->getAntZ(ant, pol) : 0;
+    }
+
+    for (int beam = 0; beam < k::NUM_BEAMS; beam++)
+    {
+      // a plane wave from elevation el reaches height z at -z sin(el) / c, so delay
+      // every channel to line up with the last arrival
+      double el = (el_min + (beam + 0.5) * (el_max - el_min) / k::NUM_BEAMS) * TMath::DegToRad();
+      std::array<double, k::NUM_CHANS_PER_SURF> t;
+      double tlast = -1e99;
+      for (int chan = 0; chan < k::NUM_CHANS_PER_SURF; chan++)
+      {
+        t[chan] = -z[chan] * sin(el) / C_M_PER_NS;
+        if (have[chan] && t[chan] > tlast) tlast = t[chan];
+      }
+
+      for (int chan = 0; chan < k::NUM_CHANS_PER_SURF; chan++)
+      {
+        cfg.delays[surf][beam][chan] = have[chan] ? (Short_t) lrint((tlast - t[chan]) * NOMINAL_SAMPLES_PER_NS) : -1;
+      }
+    }
+  }
+  return cfg;
+}
+
+
+int pueo::BeamResult::nFired() const
+{
+  int n = 0;
+  for (auto f : fired) n += __builtin_popcountll(f);
+  return n;
+}
+
+
+void pueo::BeamEmulator::emulate(const RawEvent & ev, const daqhsk::DaqHsk & hsk, BeamResult & out, int nthreads) const
+{
+  parallel::forEach(k::NUM_SURF_SLOTS, nthreads, [&](size_t surf)
+  {
+    thread_local std::vector<float> work;
+    work.resize(2 * k::NUM_SAMPLES);
+
+    const int16_t * in[k::NUM_CHANS_PER_SURF];
+    for (int chan = 0; chan < k::NUM_CHANS_PER_SURF; chan++) in[chan] = &ev.data[surf * k::NUM_CHANS_PER_SURF + chan][0];
+
+    out.fired[surf] = 0;
+    for (int beam = 0; beam < k::NUM_BEAMS; beam++)
+    {
+      int delays[k::NUM_CHANS_PER_SURF];
+      for (int chan = 0; chan < k::NUM_CHANS_PER_SURF; chan++) delays[chan] = cfg.delays[surf][beam][chan];
+
+      float power = kernels::beamPower(in, delays, k::NUM_CHANS_PER_SURF, k::NUM_SAMPLES, cfg.window, &work[0]);
+      out.power[surf][beam] = power;
+
+      const daqhsk::Beam & b = hsk.Surfs[surf].Beams[beam];
+      double threshold = b.threshold * cfg.threshold_scale;
+      out.margin[surf][beam] = threshold > 0 ? power / threshold : 0;
+      if (threshold > 0 && !b.inMask && power > threshold) out.fired[surf] |= 1ull << beam;
+    }
+  });
+}
+
+
+int pueo::BeamEmulator::emulate(Dataset & d, BeamResult & out, int nthreads) const
+{
+  const RawEvent * ev = d.raw();
+  const daqhsk::DaqHsk * hsk = d.daqhsk();
+  if (!ev || !hsk) return -1;
+  emulate(*ev, *hsk, out, nthreads);
+  return 0;
+}
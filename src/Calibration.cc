@@ -0,0 +1,235 @@
+/****************************************************************************************
+*  Calibration.cc            Implementation of the per-run waveform calibration
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/Calibration.h"
+#include "kernels.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TDirectory.h"
+#include "TMutex.h"
+
+#include <map>
+#include <list>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <iostream>
+
+
+static TMutex calib_lock;
+static size_t calib_cache_size = 8;
+
+// first run -> calibration, most recently used at the front
+static std::list<std::shared_ptr<const pueo::Calibration>> calib_cache;
+
+// first run -> file, scanned once
+static std::map<int, std::string> * calib_files = nullptr;
+static std::string calib_dir_scanned;
+
+
+pueo::Calibration::Calibration()
+{
+  gain.fill(500./2048);
+  pedestal.fill(0);
+  t0.fill(0);
+  dt.fill(1/3.);
+  lut_index.fill(-1);
+}
+
+
+std::string pueo::Calibration::getCalibDir()
+{
+  if (const char * dir = getenv("PUEO_CALIB_DIR")) return dir;
+  if (const char * dir = getenv("PUEO_UTIL_INSTALL_DIR")) return std::string(dir) + "/share/pueoCalib";
+  return "";
+}
+
+
+void pueo::Calibration::setCacheSize(size_t n)
+{
+  TLockGuard l(&calib_lock);
+  calib_cache_size = n ? n : 1;
+  while (calib_cache.size() > calib_cache_size) calib_cache.pop_back();
+}
+
+
+// must hold calib_lock
+static const std::map<int, std::string> & getCalibFiles()
+{
+  std::string dir = pueo::Calibration::getCalibDir();
+  if (calib_files && dir == calib_dir_scanned) return *calib_files;
+
+  // calibrations from another directory don't apply any more
+  if (calib_files) calib_cache.clear();
+
+  delete calib_files;
+  calib_files = new std::map<int, std::string>;
+  calib_dir_scanned = dir;
+
+  if (dir.empty()) return *calib_files;
+
+  DIR * dirp = opendir(dir.c_str());
+  if (!dirp) return *calib_files;
+
+  while (struct dirent * ent = readdir(dirp))
+  {
+    int run;
+    char tail[8] = {0};
+    if (sscanf(ent->d_name, "calib_run%d.%7s", &run, tail) == 2 && std::string(tail) == "root")
+    {
+      (*calib_files)[run] = dir + "/" + ent->d_name;
+    }
+  }
+  closedir(dirp);
+  return *calib_files;
+}
+
+
+std::shared_ptr<const pueo::Calibration> pueo::Calibration::get(int run)
+{
+  // hot path: the same run (and directory) as last time on this thread
+  thread_local int last_run = -1;
+  thread_local std::string last_dir;
+  thread_local std::shared_ptr<const Calibration> last;
+  std::string dir = getCalibDir();
+  if (last && run == last_run && dir == last_dir) return last;
+
+  TLockGuard l(&calib_lock);
+
+  const auto & files = getCalibFiles();
+
+  // the calibration that applies is the one with the largest first run <= run
+  int first_run = -1;
+  std::string file;
+  auto it = files.upper_bound(run);
+  if (it != files.begin())
+  {
+    --it;
+    first_run = it->first;
+    file = it->second;
+  }
+
+  std::shared_ptr<const Calibration> found;
+  for (auto cit = calib_cache.begin(); cit != calib_cache.end(); cit++)
+  {
+    if ((*cit)->first_run == first_run)
+    {
+      found = *cit;
+      calib_cache.splice(calib_cache.begin(), calib_cache, cit);
+      break;
+    }
+  }
+
+  if (!found)
+  {
+    std::shared_ptr<Calibration> cal(new Calibration);
+    if (!file.empty())
+    {
+      if (cal->load(file))
+      {
+        cal->first_run = first_run;
+      }
+      else
+      {
+        std::cerr << "Could not load calibration from " << file << ", using nominal constants for run " << run << std::endl;
+        cal.reset(new Calibration);
+        cal->first_run = first_run; // don't retry every time
+      }
+    }
+    calib_cache.push_front(cal);
+    while (calib_cache.size() > calib_cache_size) calib_cache.pop_back();
+    found = cal;
+  }
+
+  last_run = run;
+  last_dir = calib_dir_scanned; // what files was made from
+  last = found;
+  return found;
+}
+
+
+bool pueo::Calibration::load(const std::string & fname)
+{
+  const TString theRootPwd = gDirectory->GetPath();
+
+  TFile f(fname.c_str());
+  TTree * t = f.IsZombie() ? nullptr : (TTree*) f.Get("calib");
+  if (!t)
+  {
+    gDirectory->cd(theRootPwd);
+    return false;
+  }
+
+  Int_t chan;
+  Float_t g,p,tt0,tdt;
+  std::vector<Float_t> nonlin(LUT_SIZE);
+  t->SetBranchAddress("chan",&chan);
+  t->SetBranchAddress("gain",&g);
+  t->SetBranchAddress("pedestal",&p);
+  t->SetBranchAddress("t0",&tt0);
+  t->SetBranchAddress("dt",&tdt);
+  bool have_nonlin = t->GetBranch("nonlin");
+  if (have_nonlin) t->SetBranchAddress("nonlin", nonlin.data());
+
+  for (Long64_t i = 0; i < t->GetEntries(); i++)
+  {
+    t->GetEntry(i);
+    if (chan < 0 || chan >= k::NUM_DIGITIZED_CHANNELS) continue;
+
+    gain[chan] = g;
+    pedestal[chan] = p;
+    t0[chan] = tt0;
+    dt[chan] = tdt;
+
+    if (have_nonlin)
+    {
+      // fold gain and pedestal into the table so applying it is a single lookup
+      lut_index[chan] = fused_lut.size();
+      for (int j = 0; j < LUT_SIZE; j++) fused_lut.push_back(g * (nonlin[j] - p));
+    }
+  }
+
+  source = fname;
+  gDirectory->cd(theRootPwd);
+  return true;
+}
+
+
+void pueo::Calibration::apply(size_t chan, const Short_t * in, double * out) const
+{
+  if (lut_index[chan] < 0)
+    kernels::convert(in, out, k::NUM_SAMPLES, (double) getScale(chan), (double) getOffset(chan));
+  else
+    kernels::lookup(in, out, k::NUM_SAMPLES, &fused_lut[lut_index[chan]], LUT_OFFSET, LUT_SIZE);
+}
+
+
+void pueo::Calibration::apply(size_t chan, const Short_t * in, float * out) const
+{
+  if (lut_index[chan] < 0)
+    kernels::convert(in, out, k::NUM_SAMPLES, getScale(chan), getOffset(chan));
+  else
+    kernels::lookup(in, out, k::NUM_SAMPLES, &fused_lut[lut_index[chan]], LUT_OFFSET, LUT_SIZE);
+}
@@ -0,0 +1,185 @@
+/****************************************************************************************
+*  CompactUsefulEvent.cc            Implementation of the PUEO Compact Useful Event
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/CompactUsefulEvent.h"
+#include "pueo/UsefulEvent.h"
+#include "pueo/RawHeader.h"
+#include "pueo/GeomTool.h"
+#include "pueo/Calibration.h"
+#include "kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+pueo::CompactUsefulEvent::CompactUsefulEvent(const RawEvent & event, const RawHeader & header, Precision p)
+  : eventNumber(event.eventNumber), runNumber(event.runNumber), precision(p)
+{
+  const auto & chan_map = GeomTool::Instance().getDataChanMap();
+  auto cal = Calibration::get(header.run ? (int) header.run : runNumber);
+
+  // a nonlinearity table can't be expressed as scale and offset, so store floats instead
+  if (p == kDerived)
+  {
+    for (size_t ichan = 0; ichan < k::NUM_RF_CHANNELS; ichan++)
+    {
+      if (chan_map[ichan] >= 0 && !cal->isLinear(chan_map[ichan]))
+      {
+        precision = p = kFloat;
+        break;
+      }
+    }
+  }
+
+  if (p == kFloat) fvolts.resize(k::NUM_RF_CHANNELS * k::NUM_SAMPLES);
+  else counts.resize(k::NUM_RF_CHANNELS * k::NUM_SAMPLES);
+
+  for (size_t ichan = 0; ichan < k::NUM_RF_CHANNELS; ichan++)
+  {
+    int flight_chan = chan_map[ichan];
+
+    scale[ichan] = 0;
+    offset[ichan] = 0;
+    t0[ichan] = 0;
+    dt[ichan] = 1/3.;
+
+    if (flight_chan < 0)
+    {
+      // leave as zeros
+      continue;
+    }
+
+    t0[ichan] = cal->t0[flight_chan];
+    dt[ichan] = cal->dt[flight_chan];
+
+    if (p == kFloat)
+    {
+      cal->apply(flight_chan, &event.data[flight_chan][0], &fvolts[ichan * k::NUM_SAMPLES]);
+    }
+    else
+    {
+      scale[ichan] = cal->getScale(flight_chan);
+      offset[ichan] = cal->getOffset(flight_chan);
+      const Short_t * in = &event.data[flight_chan][0];
+      std::copy(in, in + k::NUM_SAMPLES, &counts[ichan * k::NUM_SAMPLES]);
+    }
+  }
+}
+
+
+pueo::CompactUsefulEvent::CompactUsefulEvent(const UsefulEvent & event, Precision p)
+  : eventNumber(event.eventNumber), runNumber(event.runNumber), precision(p)
+{
+  if (p == kFloat) fvolts.resize(k::NUM_RF_CHANNELS * k::NUM_SAMPLES);
+  else counts.resize(k::NUM_RF_CHANNELS * k::NUM_SAMPLES);
+
+  for (size_t ichan = 0; ichan < k::NUM_RF_CHANNELS; ichan++)
+  {
+    const auto & v = event.volts[ichan];
+    t0[ichan] = event.t0[ichan];
+    dt[ichan] = event.dt[ichan];
+
+    if (p == kFloat)
+    {
+      std::copy(v.begin(), v.end(), fvolts.begin() + ichan * k::NUM_SAMPLES);
+      continue;
+    }
+
+    // quantize to the full int16 range around the middle of the waveform
+    auto minmax = std::minmax_element(v.begin(), v.end());
+    double lo = *minmax.first;
+    double hi = *minmax.second;
+    offset[ichan] = 0.5 * (hi + lo);
+    scale[ichan] = hi > lo ? (hi - lo) / 65534. : 1;
+
+    // quantize against the stored (float) values, so decoding matches; for a large DC level
+    // and a tiny range, their rounding can push the extremes past the int16 range
+    Short_t * out = &counts[ichan * k::NUM_SAMPLES];
+    double off = offset[ichan];
+    double inv = 1. / (double) scale[ichan];
+    for (size_t i = 0; i < k::NUM_SAMPLES; i++)
+    {
+      out[i] = (Short_t) std::max(-32767L, std::min(32767L, std::lrint((v[i] - off) * inv)));
+    }
+  }
+}
+
+
+void pueo::CompactUsefulEvent::getVolts(size_t chan, double * out) const
+{
+  if (precision == kFloat)
+  {
+    const Float_t * in = &fvolts[chan * k::NUM_SAMPLES];
+    std::copy(in, in + k::NUM_SAMPLES, out);
+    return;
+  }
+
+  kernels::convert(&counts[chan * k::NUM_SAMPLES], out, k::NUM_SAMPLES, (double) scale[chan], (double) offset[chan]);
+}
+
+
+void pueo::CompactUsefulEvent::getVolts(size_t chan, float * out) const
+{
+  if (precision == kFloat)
+  {
+    const Float_t * in = &fvolts[chan * k::NUM_SAMPLES];
+    std::copy(in, in + k::NUM_SAMPLES, out);
+    return;
+  }
+
+  kernels::convert(&counts[chan * k::NUM_SAMPLES], out, k::NUM_SAMPLES, scale[chan], offset[chan]);
+}
+
+
+void pueo::CompactUsefulEvent::toUseful(UsefulEvent & useful) const
+{
+  useful.eventNumber = eventNumber;
+  useful.runNumber = runNumber;
+  for (auto & chan : useful.data) chan.fill(0);
+
+  for (size_t ichan = 0; ichan < k::NUM_RF_CHANNELS; ichan++)
+  {
+    getVolts(ichan, &useful.volts[ichan][0]);
+    useful.t0[ichan] = t0[ichan];
+    useful.dt[ichan] = dt[ichan];
+  }
+}
+
+
+void pueo::CompactUsefulEvent::invertPolarity()
+{
+  if (precision == kFloat)
+  {
+    for (auto & v : fvolts) v = -v;
+    return;
+  }
+
+  // flipping the scale keeps the counts (and the raw ADC values) intact
+  for (size_t ichan = 0; ichan < k::NUM_RF_CHANNELS; ichan++)
+  {
+    scale[ichan] = -scale[ichan];
+    offset[ichan] = -offset[ichan];
+  }
+}
+
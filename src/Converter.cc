@@ -35,6 +35,11 @@
 
 #include "TFile.h"
 #include "TTree.h"
+#include "TROOT.h"
+#include "TTreeFormula.h"
+#include "TMemFile.h"
+#include "TObjArray.h"
+#include "TParameter.h"
 
 #include <vector>
 #include <iostream>
@@ -48,6 +53,86 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <unordered_map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <queue>
+#include <tuple>
+#include <limits>
+#include <cmath>
+#include <functional>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#endif
+
+
+
+// splits "a,b,c" into its parts
+static std::vector<std::string> splitCommas(const char * s)
+{
+  std::vector<std::string> parts;
+  if (!s) s = "";
+  const char * start = s;
+  for (const char * c = s; ; c++)
+  {
+    if (*c == ',' || !*c)
+    {
+      parts.emplace_back(start, c - start);
+      if (!*c) break;
+      start = c + 1;
+    }
+  }
+  return parts;
+}
+
+
+static Long64_t mtimeOf(const struct stat & st)
+{
+  return Long64_t(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+
+/* Sequential reading wants big clusters and baskets: fewer, larger reads that compress better.
+ * Random access wants the opposite, since reading one entry decompresses its whole basket
+ * for every branch. Clusters of a fixed number of entries keep baskets from straddling
+ * clusters, and an event (~0.5 MB) gets a cluster to itself.
+ */
+pueo::convert::Layout pueo::convert::getLayout(const char * typetag, layout_t profile)
+{
+  bool event = typetag && !strcmp(typetag, tags::event);
+  bool header = typetag && !strcmp(typetag, tags::header);
+
+  Layout l;
+  if (profile == kSequential)
+  {
+    l.auto_flush = event ? -256000000 : -64000000;
+    l.basket_size = event ? 4000000 : header ? 512000 : 256000;
+  }
+  else if (profile == kRandomAccess)
+  {
+    l.auto_flush = event ? 1 : 1000;
+    l.basket_size = event ? 512000 : header ? 32000 : 16000;
+  }
+  return l;
+}
+
+
+void pueo::convert::applyLayout(TTree * t, const char * typetag, layout_t profile)
+{
+  if (profile == kDefaultLayout) return;
+  Layout l = getLayout(typetag, profile);
+  if (l.auto_flush) t->SetAutoFlush(l.auto_flush);
+  if (l.basket_size) t->SetBasketSize("*", l.basket_size);
+}
 
 
 
@@ -72,6 +157,10 @@ PUEO_CONVERTIBLE_TYPES(TREE_NAME_TEMPLATE)
 PUEO_CONVERTIBLE_TYPES(INDEX_MAJOR_TEMPLATE)
 PUEO_CONVERTIBLE_TYPES(INDEX_MINOR_TEMPLATE)
 
+// anything else a type needs written next to its tree
+template <typename T> void writeSideTables(TDirectory * d) { (void) d; }
+template <> void writeSideTables<pueo::hsk::Reading>(TDirectory * d) { pueo::hsk::SensorTable::fromRawData().write(d); }
+
 static const char * getTagFromRawName(const char* raw_name)
 {
 
@@ -91,229 +180,1375 @@ static const char * getTagFromRawName(const char* raw_name)
 
 
 
-template <typename RootType, typename RawType, int (*ReaderFn)(pueo_handle_t*, RawType*), pueo::convert::postprocess_fn PostProcess  = nullptr, bool Arity = false>
-static int converterImpl(size_t N, const char ** infiles,  const char * outfile, const pueo::convert::ConvertOpts & opts  )
+
+/* Which inputs (by canonical path, size and modification time) an output was
+ * made from and how many packets were read from each. It's kept in the output as
+ * a small tree, so that appending to it later only has to read what's new.
+ */
+class Manifest
 {
+  public:
+    static constexpr const char * tree_name = "convertManifest";
+
+    struct Input
+    {
+      Long64_t size = 0;
+      Long64_t mtime = 0; ///< ns
+      Long64_t npackets = 0;
+    };
+
+    void read(TDirectory * d);
+    void write(TDirectory * d) const;
+
+    /** Packets of an input already converted, or -1 if it hasn't changed since */
+    Long64_t alreadyRead(const std::string & name, const struct stat & st) const;
+    void record(const std::string & name, const struct stat & st, Long64_t npackets);
 
-  std::string tmpfilename = outfile + std::string(opts.tmp_suffix);
+    /** Entries decoded for the output so far (before decimation), so that appending keeps every Nth entry in phase */
+    Long64_t getSeen() const { return nseen; }
+    void setSeen(Long64_t n) { nseen = n; }
 
-  TFile outf(tmpfilename.c_str(), "RECREATE");
-  outf.SetCompressionAlgorithm(opts.compression_algo);
-  outf.SetCompressionLevel(opts.compression_level);
+  private:
+    mutable std::mutex lock;
+    std::map<std::string, Input> inputs;
+    Long64_t nseen = 0;
+};
 
-  if (!outf.IsOpen())
+
+static std::string canonicalName(const char * f)
+{
+  char * real = realpath(f, NULL);
+  std::string name = real ? real : f;
+  free(real);
+  return name;
+}
+
+
+void Manifest::read(TDirectory * d)
+{
+  TTree * m = d->Get<TTree>(tree_name);
+  if (!m) return;
+
+  std::string * name = nullptr;
+  Input in;
+  m->SetBranchAddress("file", &name);
+  m->SetBranchAddress("size", &in.size);
+  m->SetBranchAddress("mtime", &in.mtime);
+  m->SetBranchAddress("npackets", &in.npackets);
+
+  std::lock_guard<std::mutex> l(lock);
+  for (Long64_t i = 0; i < m->GetEntries(); i++)
   {
-    std::cerr <<"Couldn't open temporary output file " << tmpfilename << std::endl;
-    return -1;
+    m->GetEntry(i);
+    inputs[*name] = in;
   }
 
-  const char * typetag = getName<RootType>();
-  const char * treename = getTreeName<RootType>();
+  // an output read after an earlier part of the same run has seen more
+  TParameter<Long64_t> * seen = (TParameter<Long64_t>*) m->GetUserInfo()->FindObject("nseen");
+  if (seen) nseen = std::max(nseen, seen->GetVal());
+  delete m;
+  delete name;
+}
 
-  Long64_t old_max_size = TTree::GetMaxTreeSize();
-  TTree::SetMaxTreeSize(1000000000000LL);
-  TTree * t = new TTree(treename, treename);
-  t->SetAutoSave(0);
-  RootType * R = new RootType();
-  t->Branch(typetag, &R);
-  RawType r;
 
-  int nprocessed = 0;
+void Manifest::write(TDirectory * d) const
+{
+  d->cd();
+  TTree * m = new TTree(tree_name, "Inputs converted into this file");
+  std::string name;
+  Input in;
+  m->Branch("file", &name);
+  m->Branch("size", &in.size, "size/L");
+  m->Branch("mtime", &in.mtime, "mtime/L");
+  m->Branch("npackets", &in.npackets, "npackets/L");
+  m->GetUserInfo()->Add(new TParameter<Long64_t>("nseen", nseen));
+
+  std::lock_guard<std::mutex> l(lock);
+  for (const auto & entry : inputs)
+  {
+    name = entry.first;
+    in = entry.second;
+    m->Fill();
+  }
+  m->Write("", TObject::kOverwrite);
+  delete m;
+}
+
 
-  for (size_t i = 0; i < N; i++)
+Long64_t Manifest::alreadyRead(const std::string & name, const struct stat & st) const
+{
+  std::lock_guard<std::mutex> l(lock);
+  auto it = inputs.find(name);
+  if (it == inputs.end()) return 0;
+
+  const Input & in = it->second;
+  if (in.size == st.st_size && in.mtime == mtimeOf(st)) return -1;
+
+  if (st.st_size <= in.size)
   {
-    pueo_handle_t h;
-    std::cout << "Processing file " << infiles[i] << std::endl;
-    pueo_handle_init(&h, infiles[i], "r");
+    std::cerr << name << " changed since it was converted (and didn't just grow), only reading past the " << in.npackets << " packets already converted" << std::endl;
+  }
+  return in.npackets;
+}
 
 
-    while (ReaderFn(&h, &r) > 0)
+void Manifest::record(const std::string & name, const struct stat & st, Long64_t npackets)
+{
+  std::lock_guard<std::mutex> l(lock);
+  Input & in = inputs[name];
+  in.size = st.st_size;
+  in.mtime = mtimeOf(st);
+  in.npackets = npackets;
+}
+
+
+// Adds the time until it goes out of scope to a total (ns)
+class StageTimer
+{
+  public:
+    StageTimer(std::atomic<Long64_t> & t) : total(t), start(std::chrono::steady_clock::now()) { ; }
+    ~StageTimer() { total += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(); }
+
+  private:
+    std::atomic<Long64_t> & total;
+    std::chrono::steady_clock::time_point start;
+};
+
+
+static std::string jsonString(const std::string & str)
+{
+  std::string out = "\"";
+  for (char c : str)
+  {
+    if (c == '"' || c == '\\') out += '\\';
+    if ((unsigned char) c < 0x20) { char esc[8]; snprintf(esc, sizeof(esc), "\\u%04x", c); out += esc; continue; }
+    out += c;
+  }
+  return out + "\"";
+}
+
+
+/* Where the time went and what came out, for the conversion report.
+ * Stage times are summed over threads, so they can add up to more than the wall time.
+ */
+struct InputStats
+{
+  std::atomic<Long64_t> files{0};
+  std::atomic<Long64_t> bytes{0};
+  std::atomic<Long64_t> packets{0};
+  std::atomic<Long64_t> read_ns{0};
+};
+
+
+struct OutputStats
+{
+  std::string typetag;
+  std::string outfile;
+  std::atomic<Long64_t> construct_ns{0}, fill_ns{0}, sort_ns{0}, tune_ns{0}, index_ns{0}, write_ns{0}, postprocess_ns{0};
+  Long64_t entries = 0;
+  Long64_t output_bytes = 0;
+  Long64_t tot_bytes = 0, zip_bytes = 0;
+
+  struct Branch
+  {
+    std::string name;
+    Long64_t tot_bytes, zip_bytes;
+  };
+  std::vector<Branch> branches;
+
+  // every branch (and sub-branch) of the tree, before it's closed
+  void addBranches(TObjArray * list)
+  {
+    if (!list) return;
+    for (int i = 0; i < list->GetEntriesFast(); i++)
     {
-      if constexpr (Arity)
+      TBranch * b = (TBranch*) list->UncheckedAt(i);
+      branches.push_back(Branch{b->GetName(), b->GetTotBytes(), b->GetZipBytes()});
+      addBranches(b->GetListOfBranches());
+    }
+  }
+
+  void addTree(TTree * t)
+  {
+    tot_bytes = t->GetTotBytes();
+    zip_bytes = t->GetZipBytes();
+    entries = t->GetEntries();
+    branches.clear();
+    addBranches(t->GetListOfBranches());
+  }
+
+  void write(FILE * f, double wall) const
+  {
+    fprintf(f, "    {\n");
+    fprintf(f, "      \"typetag\": %s,\n", jsonString(typetag).c_str());
+    fprintf(f, "      \"file\": %s,\n", jsonString(outfile).c_str());
+    fprintf(f, "      \"entries\": %lld,\n", (long long) entries);
+    fprintf(f, "      \"output_bytes\": %lld,\n", (long long) output_bytes);
+    fprintf(f, "      \"output_MB_per_second\": %g,\n", wall > 0 ? output_bytes / 1048576. / wall : 0.);
+    fprintf(f, "      \"compression_ratio\": %g,\n", zip_bytes > 0 ? double(tot_bytes) / zip_bytes : 0.);
+    fprintf(f, "      \"stage_seconds\": { \"construct\": %g, \"fill\": %g, \"sort\": %g, \"tune\": %g, \"index\": %g, \"write\": %g, \"postprocess\": %g },\n",
+        construct_ns * 1e-9, fill_ns * 1e-9, sort_ns * 1e-9, tune_ns * 1e-9, index_ns * 1e-9, write_ns * 1e-9, postprocess_ns * 1e-9);
+    fprintf(f, "      \"branches\": [");
+    for (size_t i = 0; i < branches.size(); i++)
+    {
+      const Branch & b = branches[i];
+      fprintf(f, "%s\n        { \"name\": %s, \"tot_bytes\": %lld, \"zip_bytes\": %lld, \"compression_ratio\": %g }", i ? "," : "",
+          jsonString(b.name).c_str(), (long long) b.tot_bytes, (long long) b.zip_bytes, b.zip_bytes > 0 ? double(b.tot_bytes) / b.zip_bytes : 0.);
+    }
+    fprintf(f, "%s]\n", branches.size() ? "\n      " : "");
+    fprintf(f, "    }");
+  }
+};
+
+
+static void writeStats(const char * path, double wall, int nthreads, const InputStats & in, const std::vector<const OutputStats*> & out)
+{
+  FILE * f = fopen(path, "w");
+  if (!f)
+  {
+    std::cerr << "Couldn't write stats to " << path << std::endl;
+    return;
+  }
+
+  fprintf(f, "{\n");
+  fprintf(f, "  \"wall_seconds\": %g,\n", wall);
+  fprintf(f, "  \"threads\": %d,\n", nthreads);
+  fprintf(f, "  \"input_files\": %lld,\n", (long long) in.files);
+  fprintf(f, "  \"input_bytes\": %lld,\n", (long long) in.bytes);
+  fprintf(f, "  \"packets\": %lld,\n", (long long) in.packets);
+  fprintf(f, "  \"packets_per_second\": %g,\n", wall > 0 ? in.packets / wall : 0.);
+  fprintf(f, "  \"input_MB_per_second\": %g,\n", wall > 0 ? in.bytes / 1048576. / wall : 0.);
+  fprintf(f, "  \"stage_seconds\": { \"raw_read\": %g },\n", in.read_ns * 1e-9);
+  fprintf(f, "  \"outputs\": [\n");
+  for (size_t i = 0; i < out.size(); i++)
+  {
+    out[i]->write(f, wall);
+    fprintf(f, "%s\n", i + 1 < out.size() ? "," : "");
+  }
+  fprintf(f, "  ]\n");
+  fprintf(f, "}\n");
+  fclose(f);
+}
+
+
+/* Per-branch compression settings picked by tuning (or read back from an earlier tuned file),
+ * recorded in the output as a small tree so that a campaign can reuse them.
+ */
+class CompressionChoices
+{
+  public:
+    static constexpr const char * tree_name = "compressionChoices";
+
+    struct Choice
+    {
+      int algorithm;
+      int level;
+      int basket_size;
+      Long64_t tot_bytes = 0;  ///< in the tuning sample
+      Long64_t zip_bytes = 0;
+      Long64_t decode_ns = 0;
+    };
+
+    std::map<std::string, Choice> branches;
+    std::string description;
+
+    bool empty() const { return branches.empty(); }
+
+    /** The choices made for tree (by name) in a file */
+    void read(TDirectory * d, const char * tree);
+    void write(TDirectory * d, const char * tree) const;
+
+    /** Set the compression and basket size of every branch we have a choice for */
+    void apply(TTree * t) const { apply(t->GetListOfBranches()); }
+
+  private:
+    void apply(TObjArray * list) const;
+};
+
+
+void CompressionChoices::read(TDirectory * d, const char * tree)
+{
+  TTree * c = d->Get<TTree>(tree_name);
+  if (!c) return;
+
+  std::string * tname = nullptr;
+  std::string * bname = nullptr;
+  Choice ch;
+  c->SetBranchAddress("tree", &tname);
+  c->SetBranchAddress("branch", &bname);
+  c->SetBranchAddress("algorithm", &ch.algorithm);
+  c->SetBranchAddress("level", &ch.level);
+  c->SetBranchAddress("basket_size", &ch.basket_size);
+  c->SetBranchAddress("tot_bytes", &ch.tot_bytes);
+  c->SetBranchAddress("zip_bytes", &ch.zip_bytes);
+  c->SetBranchAddress("decode_ns", &ch.decode_ns);
+  for (Long64_t i = 0; i < c->GetEntries(); i++)
+  {
+    c->GetEntry(i);
+    if (*tname == tree) branches[*bname] = ch;
+  }
+  description = c->GetTitle();
+  delete c;
+  delete tname;
+  delete bname;
+}
+
+
+void CompressionChoices::write(TDirectory * d, const char * tree) const
+{
+  if (empty()) return;
+
+  d->cd();
+  TTree * c = new TTree(tree_name, description.c_str());
+  std::string tname = tree;
+  std::string bname;
+  Choice ch;
+  c->Branch("tree", &tname);
+  c->Branch("branch", &bname);
+  c->Branch("algorithm", &ch.algorithm, "algorithm/I");
+  c->Branch("level", &ch.level, "level/I");
+  c->Branch("basket_size", &ch.basket_size, "basket_size/I");
+  c->Branch("tot_bytes", &ch.tot_bytes, "tot_bytes/L");
+  c->Branch("zip_bytes", &ch.zip_bytes, "zip_bytes/L");
+  c->Branch("decode_ns", &ch.decode_ns, "decode_ns/L");
+  for (const auto & b : branches)
+  {
+    bname = b.first;
+    ch = b.second;
+    c->Fill();
+  }
+  c->Write("", TObject::kOverwrite);
+  delete c;
+}
+
+
+void CompressionChoices::apply(TObjArray * list) const
+{
+  if (!list) return;
+  for (int i = 0; i < list->GetEntriesFast(); i++)
+  {
+    TBranch * b = (TBranch*) list->UncheckedAt(i);
+    auto it = branches.find(b->GetName());
+    if (it != branches.end())
+    {
+      b->SetCompressionSettings(ROOT::CompressionSettings((ROOT::RCompressionSetting::EAlgorithm::EValues) it->second.algorithm, it->second.level));
+      b->SetBasketSize(it->second.basket_size);
+    }
+    apply(b->GetListOfBranches());
+  }
+}
+
+
+// branches with no sub-branches, i.e. the ones actually holding data
+static void leafBranches(TObjArray * list, std::vector<TBranch*> & out)
+{
+  if (!list) return;
+  for (int i = 0; i < list->GetEntriesFast(); i++)
+  {
+    TBranch * b = (TBranch*) list->UncheckedAt(i);
+    TObjArray * sub = b->GetListOfBranches();
+    if (!sub || !sub->GetEntriesFast()) out.push_back(b);
+    else leafBranches(sub, out);
+  }
+}
+
+
+/* One output file made from a raw type. Several can share one read pass over
+ * the input: readers decode each raw packet once for every product, and the
+ * writer fills each product's tree in input order. Decoded objects are passed
+ * around untyped so that products of different ROOT types can share a queue.
+ */
+template <typename RawType>
+class Product
+{
+  public:
+    virtual ~Product() { ; }
+
+    /** Opens the temporary output (or the existing one, when appending) and sets up the tree. */
+    virtual bool open() = 0;
+
+    /** Reader threads: decode r, appending to out. Returns the bytes decoded. */
+    virtual size_t decode(RawType * r, std::vector<void*> & out) = 0;
+
+    /** Writer thread: fill (or decimate) and recycle decoded objects */
+    virtual void fill(std::vector<void*> & objs) = 0;
+
+    /** Throw away a decoded object without filling it */
+    virtual void discard(void * obj) = 0;
+
+    /** Sort, index, write and move into place. Returns 0 on success. */
+    virtual int close() = 0;
+
+    /** Entries this conversion added to the output (after decimation, not counting ones that failed to convert). Valid after close(). */
+    Long64_t getNFilled() const { return stats.entries - entries_before; }
+
+    /** What this output was made from. Readers use it to skip what's already converted. */
+    Manifest & getManifest() { return manifest; }
+
+    OutputStats & getStats() { return stats; }
+
+  protected:
+    Long64_t entries_before = 0; ///< already in the output, when appending
+    Manifest manifest;
+    OutputStats stats;
+};
+
+
+template <typename RootType, typename RawType, pueo::convert::postprocess_fn PostProcess, bool Arity>
+class ProductImpl : public Product<RawType>
+{
+  public:
+    ProductImpl(const pueo::convert::ConvertOutput & out, const pueo::convert::ConvertOpts & o)
+      : outfile(out.outfile), tmpfilename(out.outfile + std::string(o.tmp_suffix)), decimate(out.decimate > 0 ? out.decimate : 1), opts(o),
+        appending(o.append && !access(out.outfile, F_OK)), manifest_from(out.manifest_from ? out.manifest_from : ""),
+        tuning(o.compression_tuning != pueo::convert::kNoTuning && !appending && !(o.compression_from && *o.compression_from))
+    {
+      size_t buffer_bytes = size_t(std::max(o.sort_buffer_mb, 1)) << 20;
+      sort_capacity = std::max<size_t>(1, buffer_bytes / sizeof(RootType));
+      this->stats.typetag = getName<RootType>();
+      this->stats.outfile = outfile;
+    }
+
+    virtual ~ProductImpl()
+    {
+      for (const Pending & p : pending) discard(p.obj);
+      for (RootType * obj : sample) discard(obj);
+      key.reset();
+      spill.reset();
+      outf.reset();
+      delete R;
+      for (RootType * obj : pool) ::operator delete(obj);
+    }
+
+    virtual bool open()
+    {
+      if (manifest_from.size())
       {
-        int num_items = pueo::convert::arity(&r);
-        for (int j = 0; j < num_items; j++)
+        TFile prev(manifest_from.c_str(), "READ");
+        if (prev.IsOpen()) this->manifest.read(&prev);
+      }
+
+      nseen = this->manifest.getSeen();
+      if (appending) return openExisting();
+
+      if (opts.compression_from && *opts.compression_from)
+      {
+        for (const std::string & f : splitCommas(opts.compression_from))
         {
-          nprocessed++;
-          R->~RootType();
-          try
-          {
-            R = new (R) RootType(&r, j);
-            t->Fill();
-          }
-          catch (const char * f)
-          {
-            std::cerr << "Conversion Exception: " << f << std::endl;
-          }
+          TFile prev(f.c_str(), "READ");
+          if (prev.IsOpen()) choices.read(&prev, getTreeName<RootType>());
+        }
+        if (choices.empty()) std::cerr << "No compression choices for " << getTreeName<RootType>() << " in " << opts.compression_from << ", using the defaults" << std::endl;
+      }
+
+      outf.reset(new TFile(tmpfilename.c_str(), "RECREATE"));
+      outf->SetCompressionAlgorithm(opts.compression_algo);
+      outf->SetCompressionLevel(opts.compression_level);
+
+      if (!outf->IsOpen())
+      {
+        std::cerr <<"Couldn't open temporary output file " << tmpfilename << std::endl;
+        return false;
+      }
+
+      // outf is the current directory, so the tree goes in it
+      t = new TTree(getTreeName<RootType>(), getTreeName<RootType>());
+      t->SetAutoSave(0);
+      R = new RootType();
+      br = t->Branch(getName<RootType>(), &R);
+      pueo::convert::applyLayout(t, getName<RootType>(), opts.layout);
+      choices.apply(t);
+      return setupSort();
+    }
+
+    // append to the output in place: new entries go after the old ones, then the index and manifest are rewritten
+    bool openExisting()
+    {
+      if (PostProcess != nullptr)
+      {
+        std::cerr << "Can't append to " << outfile << " since " << getName<RootType>() << " is postprocessed" << std::endl;
+        return false;
+      }
 
+      outf.reset(new TFile(outfile.c_str(), "UPDATE"));
+      t = outf->IsOpen() ? outf->Get<TTree>(getTreeName<RootType>()) : nullptr;
+      if (!t)
+      {
+        std::cerr << "Couldn't find " << getTreeName<RootType>() << " to append to in " << outfile << std::endl;
+        return false;
+      }
+
+      R = new RootType();
+      t->SetBranchAddress(getName<RootType>(), &R);
+      br = t->GetBranch(getName<RootType>());
+      this->entries_before = t->GetEntries();
+      pueo::convert::applyLayout(t, getName<RootType>(), opts.layout);
+      this->manifest.read(outf.get());
+      nseen = this->manifest.getSeen();
+      return setupSort();
+    }
+
+    bool setupSort()
+    {
+      if (opts.sort_by)
+      {
+        // Evaluated on the entry in memory rather than read back from the tree:
+        // with quick load, nothing is loaded as long as the tree was never read.
+        key.reset(new TTreeFormula("sort_by", opts.sort_by, t));
+        if (!key->GetNdim())
+        {
+          std::cerr << "Couldn't make sense of sort expression \"" << opts.sort_by << "\"" << std::endl;
+          return false;
+        }
+        key->SetQuickLoad(true);
+
+        if (!appending)
+        {
+          // the first run goes straight into the output, unless that already has entries
+          runs.push_back(Run{t, {}});
+        }
+        else if (t->GetEntries())
+        {
+          // New entries are only sorted among themselves and go after the existing ones (which
+          // are sorted, so the last has the largest key), so we can tell if that breaks the order.
+          // Read before any new entry is evaluated, and the tree is left at this entry so that
+          // quick load still doesn't read anything back.
+          TTreeFormula last("sort_by_last", opts.sort_by, t);
+          t->LoadTree(t->GetEntries() - 1);
+          last.GetNdata();
+          existing_last_key = last.EvalInstance(0);
+          if (std::isnan(existing_last_key)) existing_last_key = std::numeric_limits<double>::infinity();
         }
       }
+      return true;
+    }
+
+    virtual size_t decode(RawType * r, std::vector<void*> & out)
+    {
+      StageTimer timer(this->stats.construct_ns);
+      size_t before = out.size();
+      if constexpr (Arity)
+      {
+        int num_items = pueo::convert::arity(r);
+        for (int j = 0; j < num_items; j++) add(out, r, j);
+      }
       else
       {
+        add(out, r);
+      }
+      return (out.size() - before) * sizeof(RootType);
+    }
 
-        nprocessed++;
-        R->~RootType();
-        try
+    virtual void fill(std::vector<void*> & objs)
+    {
+      for (void * p : objs)
+      {
+        RootType * obj = static_cast<RootType*>(p);
+        if (nseen++ % decimate)
+        {
+          discard(obj);
+        }
+        else if (tuning)
         {
-          R = new (R) RootType(&r);
-          t->Fill();
+          sample.push_back(obj);
+          if (sample.size() >= size_t(std::max(opts.tune_entries, 1))) finishTuning();
         }
-        catch (const char * f)
+        else
         {
-          std::cerr <<  "Conversion Exception: " << f << std::endl;
+          place(obj);
         }
       }
     }
-    pueo_handle_close(&h);
+
+    virtual void discard(void * p)
+    {
+      RootType * obj = static_cast<RootType*>(p);
+      obj->~RootType();
+      std::lock_guard<std::mutex> l(pool_lock);
+      pool.push_back(obj);
+    }
+
+    virtual int close();
+
+  private:
+    void place(RootType * obj)
+    {
+      if (!key)
+      {
+        fillWith(t, obj);
+        discard(obj);
+      }
+      else
+      {
+        sortIn(obj);
+      }
+    }
+
+    // pick the compression from the sample, then let the sample through
+    void finishTuning()
+    {
+      tuning = false;
+      if (sample.size())
+      {
+        StageTimer timer(this->stats.tune_ns);
+        tune();
+        choices.apply(t);
+      }
+      for (RootType * obj : sample) place(obj);
+      sample.clear();
+    }
+
+    void tune();
+
+    template <typename ... Args>
+    void add(std::vector<void*> & out, RawType * r, Args ... args)
+    {
+      RootType * obj = alloc();
+      try
+      {
+        new (obj) RootType(r, args...);
+        out.push_back(obj);
+      }
+      catch (const char * f)
+      {
+        std::lock_guard<std::mutex> l(pool_lock);
+        pool.push_back(obj);
+        std::cerr << "Conversion Exception: " << f << std::endl;
+      }
+    }
+
+    RootType * alloc()
+    {
+      std::lock_guard<std::mutex> l(pool_lock);
+      if (pool.empty()) return static_cast<RootType*>(::operator new(sizeof(RootType)));
+      RootType * obj = pool.back();
+      pool.pop_back();
+      return obj;
+    }
+
+    void fillWith(TTree * tree, RootType * obj)
+    {
+      StageTimer timer(this->stats.fill_ns);
+      RootType * R0 = R;
+      R = obj; // the branch holds &R
+      tree->Fill();
+      R = R0;
+    }
+
+    /* Sorting on ingest is replacement selection: entries wait in a bounded heap and
+     * the smallest is written out whenever it's full. Entries smaller than the last
+     * one written can't go in the current run any more, so they're held for the next.
+     * Nearly sorted input (anything out of order by less than the buffer) therefore
+     * ends up as a single run, written straight into the output tree. Otherwise
+     * later runs are spilled to a scratch file and merged at the end.
+     */
+    struct Pending
+    {
+      size_t run;
+      double key;
+      Long64_t seq;
+      RootType * obj;
+      bool operator>(const Pending & o) const { return std::tie(run, key, seq) > std::tie(o.run, o.key, o.seq); }
+    };
+
+    struct Run
+    {
+      TTree * tree;
+      std::vector<std::pair<double,Long64_t>> keys;
+    };
+
+    void sortIn(RootType * obj)
+    {
+      {
+        StageTimer timer(this->stats.sort_ns);
+        RootType * R0 = R;
+        R = obj;
+        br->SetAddress(&R);
+        key->GetNdata();
+        double k = key->EvalInstance(0);
+        R = R0;
+        if (std::isnan(k)) k = std::numeric_limits<double>::infinity();
+        min_new_key = std::min(min_new_key, k);
+
+        pending.push_back(Pending{k < last_key ? cur_run + 1 : cur_run, k, nsorted++, obj});
+        std::push_heap(pending.begin(), pending.end(), std::greater<Pending>());
+      }
+      if (pending.size() >= sort_capacity) sortOut();
+    }
+
+    void sortOut()
+    {
+      Pending p;
+      {
+        StageTimer timer(this->stats.sort_ns);
+        std::pop_heap(pending.begin(), pending.end(), std::greater<Pending>());
+        p = pending.back();
+        pending.pop_back();
+
+        if (p.run != cur_run)
+        {
+          cur_run = p.run;
+          last_key = -std::numeric_limits<double>::infinity();
+        }
+        if (cur_run >= runs.size()) startRun();
+        last_key = p.key;
+        runs[cur_run].keys.emplace_back(p.key, p.seq);
+      }
+      fillWith(runs[cur_run].tree, p.obj);
+      discard(p.obj);
+    }
+
+    void startRun()
+    {
+      if (!spill)
+      {
+        std::string spillname = tmpfilename + ".spill";
+        spill.reset(new TFile(spillname.c_str(), "RECREATE"));
+        spill->SetCompressionAlgorithm(ROOT::RCompressionSetting::EAlgorithm::kLZ4);
+        spill->SetCompressionLevel(1);
+      }
+      spill->cd();
+      TString name = TString::Format("run%zu", runs.size());
+      TTree * tree = new TTree(name, name);
+      tree->SetAutoSave(0);
+      tree->Branch(getName<RootType>(), &R);
+      runs.push_back(Run{tree, {}});
+    }
+
+    void merge(TTree * t_sorted);
+
+    std::string outfile;
+    std::string tmpfilename;
+    Long64_t decimate;
+    Long64_t nseen = 0;
+    const pueo::convert::ConvertOpts & opts;
+    bool appending;
+    std::string manifest_from;
+    std::unique_ptr<TFile> outf;
+    TTree * t = nullptr;
+    TBranch * br = nullptr;
+    RootType * R = nullptr;
+    std::mutex pool_lock;
+    std::vector<RootType*> pool;
+
+    std::unique_ptr<TTreeFormula> key;
+    size_t sort_capacity;
+    std::vector<Pending> pending; ///< heap, smallest (run, key, seq) first
+    size_t cur_run = 0;
+    double last_key = -std::numeric_limits<double>::infinity();
+    double existing_last_key = -std::numeric_limits<double>::infinity(); ///< when appending
+    double min_new_key = std::numeric_limits<double>::infinity();
+    Long64_t nsorted = 0;
+    std::vector<Run> runs;
+    std::unique_ptr<TFile> spill;
+
+    bool tuning;
+    std::vector<RootType*> sample; ///< the first entries, held until the compression is tuned on them
+    CompressionChoices choices;
+};
+
+
+// k-way merge of the sorted runs into t_sorted, reading each run sequentially
+template <typename RootType, typename RawType, pueo::convert::postprocess_fn PostProcess, bool Arity>
+void ProductImpl<RootType,RawType,PostProcess,Arity>::merge(TTree * t_sorted)
+{
+  typedef std::tuple<double, Long64_t, size_t, size_t> Head; // key, seq, run, entry
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+
+  std::vector<RootType*> bufs(runs.size());
+  for (size_t r = 0; r < runs.size(); r++)
+  {
+    runs[r].tree->FlushBaskets();
+    bufs[r] = new RootType();
+    runs[r].tree->SetBranchAddress(getName<RootType>(), &bufs[r]);
+    if (runs[r].keys.size()) heads.emplace(runs[r].keys[0].first, runs[r].keys[0].second, r, 0);
   }
 
-  bool out_of_sorts = false;
-  std::vector<std::pair<size_t,double>> sorted;
+  while (!heads.empty())
+  {
+    size_t r = std::get<2>(heads.top());
+    size_t i = std::get<3>(heads.top());
+    heads.pop();
 
-  if (opts.sort_by)
+    {
+      StageTimer timer(this->stats.sort_ns);
+      runs[r].tree->GetEntry(i);
+    }
+    fillWith(t_sorted, bufs[r]);
+
+    if (++i < runs[r].keys.size()) heads.emplace(runs[r].keys[i].first, runs[r].keys[i].second, r, i);
+  }
+
+  for (size_t r = 0; r < runs.size(); r++) runs[r].tree->ResetBranchAddresses();
+  for (RootType * b : bufs) delete b;
+}
+
+
+/* Tuning writes the sample into an in-memory file once for each candidate
+ * algorithm, level and basket size (only the layout's, with a layout profile), then times reading each leaf branch back
+ * with its baskets dropped, so decompression and streaming are both counted.
+ * Each branch gets the candidate that does best for it by the objective.
+ * It's a one-off cost at the start of a conversion; campaigns can reuse the
+ * result with ConvertOpts::compression_from.
+ */
+template <typename RootType, typename RawType, pueo::convert::postprocess_fn PostProcess, bool Arity>
+void ProductImpl<RootType,RawType,PostProcess,Arity>::tune()
+{
+  using Algo = ROOT::RCompressionSetting::EAlgorithm;
+  static const std::pair<Algo::EValues,int> settings[] = {
+    {Algo::kLZ4, 1}, {Algo::kLZ4, 4}, {Algo::kZSTD, 1}, {Algo::kZSTD, 3}, {Algo::kZSTD, 6}, {Algo::kZSTD, 9}, {Algo::kZLIB, 6}, {Algo::kLZMA, 4}
+  };
+  static const int default_basket_sizes[] = { 16000, 64000, 256000 };
+  static const int decode_repeats = 3;
+
+  const char * typetag = getName<RootType>();
+
+  // with a layout profile, the basket size is the profile's
+  std::vector<int> basket_sizes(std::begin(default_basket_sizes), std::end(default_basket_sizes));
+  pueo::convert::Layout layout = pueo::convert::getLayout(typetag, opts.layout);
+  if (layout.basket_size) basket_sizes.assign(1, layout.basket_size);
+
+  std::map<std::string, std::vector<CompressionChoices::Choice>> results;
+
+  for (const auto & setting : settings)
   {
-    //see if we are sorted or not
+    for (int basket_size : basket_sizes)
+    {
+      TMemFile mf("pueo-convert-tune.root", "RECREATE");
+      mf.SetCompressionSettings(ROOT::CompressionSettings(setting.first, setting.second));
+      TTree * s = new TTree("tune", "tune");
+      s->SetAutoSave(0);
+      RootType * obj = sample[0];
+      s->Branch(typetag, &obj);
+      pueo::convert::applyLayout(s, typetag, opts.layout);
+
+      std::vector<TBranch*> leaves;
+      leafBranches(s->GetListOfBranches(), leaves);
+      for (TBranch * b : leaves) b->SetBasketSize(basket_size);
+
+      for (RootType * x : sample)
+      {
+        obj = x;
+        s->Fill();
+      }
+      s->FlushBaskets();
 
-    size_t N = t->Draw(opts.sort_by,"","goff");
-    for (size_t i = 1; i < N; i++)
+      RootType * rd = new RootType();
+      s->SetBranchAddress(typetag, &rd);
+      for (TBranch * b : leaves)
+      {
+        Long64_t best = std::numeric_limits<Long64_t>::max();
+        for (int rep = 0; rep < decode_repeats; rep++)
+        {
+          b->DropBaskets("all");
+          auto start = std::chrono::steady_clock::now();
+          for (Long64_t i = 0; i < s->GetEntries(); i++) b->GetEntry(i);
+          best = std::min<Long64_t>(best, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        CompressionChoices::Choice c;
+        c.algorithm = setting.first;
+        c.level = setting.second;
+        c.basket_size = basket_size;
+        c.tot_bytes = b->GetTotBytes();
+        c.zip_bytes = b->GetZipBytes();
+        c.decode_ns = best;
+        results[b->GetName()].push_back(c);
+      }
+      s->ResetBranchAddresses();
+      delete rd;
+      mf.Close();
+    }
+  }
+  outf->cd();
+
+  for (const auto & r : results)
+  {
+    const std::vector<CompressionChoices::Choice> & cands = r.second;
+    double zip_min = std::numeric_limits<double>::max(), ns_min = std::numeric_limits<double>::max();
+    for (const auto & c : cands)
     {
-      if (t->GetV1()[i] < t->GetV1()[i-1]) 
+      zip_min = std::min<double>(zip_min, std::max<Long64_t>(c.zip_bytes, 1));
+      ns_min = std::min<double>(ns_min, std::max<Long64_t>(c.decode_ns, 1));
+    }
+
+    // smaller is better; ties go to the other measure
+    auto score = [&](const CompressionChoices::Choice & c)
+    {
+      double zip = std::max<Long64_t>(c.zip_bytes, 1) / zip_min;
+      double ns = std::max<Long64_t>(c.decode_ns, 1) / ns_min;
+      switch (opts.compression_tuning)
       {
-        out_of_sorts = true;
-        break;
+        case pueo::convert::kSmallest: return std::make_pair(zip, ns);
+        case pueo::convert::kFastestDecode: return std::make_pair(ns, zip);
+        default: return std::make_pair(zip + ns, zip);
       }
+    };
+
+    choices.branches[r.first] = *std::min_element(cands.begin(), cands.end(),
+        [&](const CompressionChoices::Choice & a, const CompressionChoices::Choice & b) { return score(a) < score(b); });
+  }
+
+  static const char * objectives[] = { "none", "smallest", "fastest decode", "balanced" };
+  choices.description = TString::Format("Tuned for %s on %zu entries", objectives[opts.compression_tuning], sample.size()).Data();
+}
+
+
+template <typename RootType, typename RawType, pueo::convert::postprocess_fn PostProcess, bool Arity>
+int ProductImpl<RootType,RawType,PostProcess,Arity>::close()
+{
+  const char * typetag = getName<RootType>();
+  const char * treename = getTreeName<RootType>();
+
+  if (tuning) finishTuning();
+  while (pending.size()) sortOut();
+  key.reset();
+  this->manifest.setSeen(nseen);
 
+  if (appending)
+  {
+    // every run was spilled, since the output already had entries
+    if (runs.size()) merge(t);
+
+    if (min_new_key < existing_last_key)
+    {
+      std::cerr << "  appended " << typetag << " entries go before some already in " << outfile << " by \"" << opts.sort_by
+                << "\": the index is right, but reading in entry order isn't sorted any more. Convert without appending to fix." << std::endl;
+    }
+
+    if (getIndexMajor<RootType>())
+    {
+      StageTimer timer(this->stats.index_ns);
+      t->BuildIndex(getIndexMajor<RootType>(), getIndexMinor<RootType>());
+    }
+
+    {
+      StageTimer timer(this->stats.write_ns);
+      t->Write("", TObject::kOverwrite);
+      this->manifest.write(outf.get());
+      writeSideTables<RootType>(outf.get());
+      this->stats.addTree(t);
+      outf->Close();
     }
+    outf.reset();
+    runs.clear();
 
-    if (out_of_sorts)
+    if (spill)
     {
-      sorted.resize(N);
+      spill.reset();
+      unlink((tmpfilename + ".spill").c_str());
+    }
+
+    struct stat st;
+    if (!stat(outfile.c_str(), &st)) this->stats.output_bytes = st.st_size;
+    return 0;
+  }
+
+  if (runs.size() > 1)
+  {
+    std::cout << "  " << typetag << " input is out of order by more than the sort buffer, merging " << runs.size() << " runs" << std::endl;
+
+    TFile fsorted(tmpfilename.c_str(),"RECREATE"); //will overwrite original temp file, but it will still exist until we close outf
+
+    fsorted.SetCompressionAlgorithm(opts.compression_algo);
+    fsorted.SetCompressionLevel(opts.compression_level);
+    TTree * t_sorted = new TTree(treename, treename);
+    t_sorted->SetAutoSave(0);
+    t_sorted->Branch(typetag, &R);
+    pueo::convert::applyLayout(t_sorted, typetag, opts.layout);
+    choices.apply(t_sorted);
+    merge(t_sorted);
+
+    outf->Close();
+    spill->Close();
+
+    if (getIndexMajor<RootType>())
+    {
+      StageTimer timer(this->stats.index_ns);
+      t_sorted->BuildIndex(getIndexMajor<RootType>(), getIndexMinor<RootType>());
+    }
+
+    StageTimer timer(this->stats.write_ns);
+    this->manifest.write(&fsorted);
+    choices.write(&fsorted, treename);
+    writeSideTables<RootType>(&fsorted);
+    fsorted.Write();
+    this->stats.addTree(t_sorted);
+    fsorted.Close();
+  }
+  else
+  {
+    if (getIndexMajor<RootType>())
+    {
+      StageTimer timer(this->stats.index_ns);
+      t->BuildIndex(getIndexMajor<RootType>(), getIndexMinor<RootType>());
+    }
+
+    StageTimer timer(this->stats.write_ns);
+    this->manifest.write(outf.get());
+    choices.write(outf.get(), treename);
+    writeSideTables<RootType>(outf.get());
+    outf->Write();
+    this->stats.addTree(t);
+    outf->Close();
+  }
+  outf.reset();
+  runs.clear();
+
+  if (spill)
+  {
+    spill.reset();
+    unlink((tmpfilename + ".spill").c_str());
+  }
+
+  if (PostProcess != nullptr)
+  {
+    StageTimer timer(this->stats.postprocess_ns);
+    if (!PostProcess(tmpfilename.c_str(), outfile.c_str(), opts.postprocess_args))
+    {
+      unlink(tmpfilename.c_str());
+    }
+    else
+    {
+      std::cerr << "  postprocesser for " << getName<RootType>() << "  didn't return 0, leaving stray temp file" << std::endl;
+      return -1;
+    }
+  }
+  else
+  {
+    if (rename(tmpfilename.c_str(), outfile.c_str()))
+    {
+      std::cerr << " rename returned non-zero " << std::endl;
+      return -1;
+    }
+  }
+
+  struct stat st;
+  if (!stat(outfile.c_str(), &st)) this->stats.output_bytes = st.st_size;
+  return 0;
+}
+
+
+/* Hands decoded entries from the reader threads to the writer, file by file, so
+ * that the output order is the same as reading the files one after another.
+ * Each file has a bounded queue of batches, so readers can't get too far ahead.
+ * A batch holds, for each product, the objects decoded from the same run of raw
+ * packets, so the writer can fill all the trees from one pop.
+ */
+template <typename RawType>
+class DecodeQueue
+{
+  public:
+    typedef std::vector<std::vector<void*>> Batch;
+
+    // a few MB per batch, so that big types (events) and small ones both pipeline reasonably
+    static constexpr size_t batch_bytes = 1 << 22;
+    static constexpr size_t max_batches = 4;
+
+    DecodeQueue(size_t nfiles, const std::vector<std::unique_ptr<Product<RawType>>> & p) : files(nfiles), products(p) { ; }
+
+    ~DecodeQueue()
+    {
+      for (auto & f : files)
+      {
+        for (auto & b : f.batches)
+        {
+          for (size_t k = 0; k < b.size(); k++) for (void * obj : b[k]) products[k]->discard(obj);
+        }
+      }
+    }
+
+    const std::vector<std::unique_ptr<Product<RawType>>> & getProducts() const { return products; }
+
+    Batch newBatch() const { return Batch(products.size()); }
+
+    void push(size_t ifile, Batch && b)
+    {
+      std::unique_lock<std::mutex> l(lock);
+      space.wait(l, [&] { return files[ifile].batches.size() < max_batches; });
+      files[ifile].batches.push_back(std::move(b));
+      data.notify_all();
+    }
+
+    void finish(size_t ifile)
+    {
+      std::lock_guard<std::mutex> l(lock);
+      files[ifile].done = true;
+      data.notify_all();
+    }
+
+    /** The next batch of file ifile, or false once it's exhausted */
+    bool pop(size_t ifile, Batch & b)
+    {
+      std::unique_lock<std::mutex> l(lock);
+      data.wait(l, [&] { return !files[ifile].batches.empty() || files[ifile].done; });
+      if (files[ifile].batches.empty()) return false;
+      b = std::move(files[ifile].batches.front());
+      files[ifile].batches.pop_front();
+      space.notify_all();
+      return true;
+    }
+
+  private:
+    struct FileQueue
+    {
+      std::deque<Batch> batches;
+      bool done = false;
+    };
+
+    std::vector<FileQueue> files;
+    const std::vector<std::unique_ptr<Product<RawType>>> & products;
+    std::mutex lock;
+    std::condition_variable data, space;
+};
+
+
+// Reader thread: takes files in order from next_file and decodes them into q
+template <typename RawType, int (*ReaderFn)(pueo_handle_t*, RawType*)>
+static void decodeFiles(size_t N, const char ** infiles, std::atomic<size_t> & next_file, DecodeQueue<RawType> & q, InputStats & in_stats)
+{
+  const auto & products = q.getProducts();
+  RawType r;
+  size_t i;
+  while ( (i = next_file++) < N)
+  {
+    // skip whatever each product already has (when appending)
+    std::string name = canonicalName(infiles[i]);
+    struct stat st;
+    if (stat(infiles[i], &st)) memset(&st, 0, sizeof(st));
+    std::vector<Long64_t> skip(products.size());
+    bool any = false;
+    for (size_t k = 0; k < products.size(); k++)
+    {
+      skip[k] = products[k]->getManifest().alreadyRead(name, st);
+      if (skip[k] >= 0) any = true;
+    }
+
+    if (!any)
+    {
+      q.finish(i);
+      continue;
+    }
+
+    typename DecodeQueue<RawType>::Batch batch = q.newBatch();
+    size_t bytes = 0;
+    Long64_t npackets = 0;
+
+    in_stats.files++;
+    in_stats.bytes += st.st_size;
+
+    pueo_handle_t h;
+    pueo_handle_init(&h, infiles[i], "r");
+    auto t0 = std::chrono::steady_clock::now();
+    while (ReaderFn(&h, &r) > 0)
+    {
+      auto t1 = std::chrono::steady_clock::now();
+      in_stats.read_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+
+      for (size_t k = 0; k < products.size(); k++)
+      {
+        if (skip[k] >= 0 && npackets >= skip[k]) bytes += products[k]->decode(&r, batch[k]);
+      }
+      npackets++;
 
-      for (size_t i = 0; i < N; i++)
+      if (bytes >= DecodeQueue<RawType>::batch_bytes)
       {
-        sorted[i].first = i;
-        sorted[i].second = t->GetV1()[i];
+        q.push(i, std::move(batch));
+        batch = q.newBatch();
+        bytes = 0;
       }
+      t0 = std::chrono::steady_clock::now();
+    }
+    pueo_handle_close(&h);
+    in_stats.packets += npackets;
 
-      std::sort(sorted.begin(), sorted.end(),
-          [](const auto & l, const auto & r) { return l.second < r.second; });
-
+    for (size_t k = 0; k < products.size(); k++)
+    {
+      if (skip[k] >= 0) products[k]->getManifest().record(name, st, npackets);
     }
 
+    if (bytes) q.push(i, std::move(batch));
+    q.finish(i);
   }
+}
 
 
-  if ( (!opts.sort_by || !out_of_sorts) && ( getIndexMajor<RootType>()))
-  {
-    t->BuildIndex(getIndexMajor<RootType>(), getIndexMinor<RootType>());
-  }
+template <typename RawType, int (*ReaderFn)(pueo_handle_t*, RawType*)>
+static int converterImpl(size_t N, const char ** infiles, std::vector<std::unique_ptr<Product<RawType>>> & products, const pueo::convert::ConvertOpts & opts)
+{
+  auto start = std::chrono::steady_clock::now();
+  int nthreads = opts.nthreads > 0 ? opts.nthreads : std::max(1u, std::thread::hardware_concurrency());
+  InputStats in_stats;
 
-  outf.Write();
+  Long64_t old_max_size = TTree::GetMaxTreeSize();
+  TTree::SetMaxTreeSize(1000000000000LL);
 
-  if (opts.sort_by && out_of_sorts)
+  for (auto & p : products)
   {
-    TFile fsorted(tmpfilename.c_str(),"RECREATE"); //will overwrite original temp file, but it will still exist until we close outf
-
-    fsorted.SetCompressionAlgorithm(opts.compression_algo);
-    fsorted.SetCompressionLevel(opts.compression_level);
-    TTree * t_sorted = new TTree(treename, treename);
-    t_sorted->SetAutoSave(0);
-    t_sorted->Branch(typetag, &R);
-    for (size_t i = 0; i < sorted.size(); i++)
+    if (!p->open())
     {
-      t->GetEntry(sorted[i].first);
-      t_sorted->Fill();
+      TTree::SetMaxTreeSize(old_max_size);
+      return -1;
     }
+  }
 
-    outf.Close();
+  // let ROOT compress baskets in parallel while we fill
+  bool enabled_imt = false;
+  if (nthreads > 1 && !ROOT::IsImplicitMTEnabled())
+  {
+    ROOT::EnableImplicitMT(nthreads);
+    enabled_imt = true;
+  }
 
-    if (getIndexMajor<RootType>())
+  // decode on reader threads, fill here, in input order
+  {
+    DecodeQueue<RawType> q(N, products);
+    std::atomic<size_t> next_file(0);
+    std::vector<std::thread> readers;
+    for (int ithread = 0; ithread < std::min<int>(nthreads, N); ithread++)
     {
-      t_sorted->BuildIndex(getIndexMajor<RootType>(), getIndexMinor<RootType>());
+      readers.emplace_back(decodeFiles<RawType, ReaderFn>, N, infiles, std::ref(next_file), std::ref(q), std::ref(in_stats));
     }
 
+    typename DecodeQueue<RawType>::Batch batch;
+    for (size_t i = 0; i < N; i++)
+    {
+      std::cout << "Processing file " << infiles[i] << std::endl;
+      while (q.pop(i, batch))
+      {
+        for (size_t k = 0; k < products.size(); k++) products[k]->fill(batch[k]);
+      }
+    }
 
-    fsorted.Write();
-    fsorted.Close();
+    for (auto & th : readers) th.join();
   }
-  else
+
+  bool ok = true;
+  for (auto & p : products)
   {
-    outf.Close();
+    if (p->close()) ok = false;
   }
+  int ret = ok ? int(products[0]->getNFilled()) : -1;
 
-  ::operator delete(R);
+  if (enabled_imt) ROOT::DisableImplicitMT();
 
-  if (PostProcess != nullptr)
+  //restore
+  TTree::SetMaxTreeSize(old_max_size);
+
+  if (opts.stats_file && *opts.stats_file)
   {
-    if (!PostProcess(tmpfilename.c_str(), outfile, opts.postprocess_args))
-    {
-      unlink(tmpfilename.c_str());
-    }
-    else
-    {
-      std::cerr << "  postprocesser for " << getName<RootType>() << "  didn't return 0, leaving stray temp file" << std::endl;
-      return -1;
-    }
+    std::vector<const OutputStats*> out_stats;
+    for (auto & p : products) out_stats.push_back(&p->getStats());
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    writeStats(opts.stats_file, wall, nthreads, in_stats, out_stats);
   }
-  else
+
+  return ret;
+}
+
+
+// The product for tag, or nullptr if it isn't made from RawType
+template <typename RawType>
+static std::unique_ptr<Product<RawType>> makeProduct(const pueo::convert::ConvertOutput & o, const pueo::convert::ConvertOpts & opts)
+{
+#define MAKE_PRODUCT(TAG, RAW, ROOT, POST, ARITY, IMAJOR, IMINOR)\
+  if constexpr (std::is_same<RawType, pueo_##RAW##_t>::value)\
+  {\
+    if (!strcmp(o.typetag, #TAG)) return std::unique_ptr<Product<RawType>>(new ProductImpl<ROOT, RawType, POST, ARITY>(o, opts));\
+  }
+
+  PUEO_CONVERTIBLE_TYPES(MAKE_PRODUCT)
+
+  return nullptr;
+}
+
+
+template <typename RawType, int (*ReaderFn)(pueo_handle_t*, RawType*)>
+static int convertProducts(const std::vector<pueo::convert::ConvertOutput> & outputs, size_t N, const char ** infiles, const pueo::convert::ConvertOpts & opts)
+{
+  std::vector<std::unique_ptr<Product<RawType>>> products;
+  for (const auto & o : outputs)
   {
-    if (rename(tmpfilename.c_str(), outfile))
+    products.push_back(makeProduct<RawType>(o, opts));
+    if (!products.back())
     {
-      std::cerr << " rename returned non-zero " << std::endl;
+      std::cerr << "typetag \"" << o.typetag << "\" isn't made from the same raw type as \"" << outputs[0].typetag << "\"" << std::endl;
       return -1;
     }
   }
 
-  //restore
-  TTree::SetMaxTreeSize(old_max_size);
-
-  return nprocessed;
+  return converterImpl<RawType, ReaderFn>(N, infiles, products, opts);
 }
 
 
-int pueo::convert::convertFiles(const char * typetag, int nfiles, const char ** infiles,  const char * outfile, const ConvertOpts & opts)
+int pueo::convert::convertFiles(int noutputs, const ConvertOutput * outputs_in, int nfiles, const char ** infiles, const ConvertOpts & opts)
 {
-
-  if (!opts.clobber && !access(outfile,F_OK))
+  if (noutputs <= 0 || !outputs_in)
   {
-    std::cerr << outfile << " already exists and we didn't enable clobber" <<std::endl;
-    return -1;
+    return 0;
   }
 
+  std::vector<ConvertOutput> outputs(outputs_in, outputs_in + noutputs);
+
+  for (const auto & o : outputs)
+  {
+    if (o.outfile && !opts.clobber && !opts.append && !access(o.outfile,F_OK))
+    {
+      std::cerr << o.outfile << " already exists and we didn't enable clobber" <<std::endl;
+      return -1;
+    }
+  }
 
-  if (nfiles == 0 || !infiles || !outfile)
+  if (nfiles == 0 || !infiles)
   {
     return 0;
   }
 
-  if (!typetag || !*typetag || !strcmp(typetag,"auto"))
+  for (const auto & o : outputs)
   {
-    // open the first file to figure it out, then close it as if nothing happened
-    pueo_handle_t h;
-    pueo_handle_init(&h, infiles[0], "r");
-    pueo_packet_t * packet = NULL;
-    if (pueo_ll_read_realloc(&h,&packet))
+    if (!o.outfile) return 0;
+  }
+
+  const char * detected = nullptr;
+  for (auto & o : outputs)
+  {
+    if (o.typetag && *o.typetag && strcmp(o.typetag,"auto")) continue;
+
+    if (!detected)
     {
-      switch(packet->head.type)
+      // open the first file to figure it out, then close it as if nothing happened
+      pueo_handle_t h;
+      pueo_handle_init(&h, infiles[0], "r");
+      pueo_packet_t * packet = NULL;
+      if (pueo_ll_read_realloc(&h,&packet))
       {
+        switch(packet->head.type)
+        {
 #define DISPATCH_TYPE(TAG, NAME)\
-        case TAG:\
-          typetag = getTagFromRawName(#NAME); break;
-        PUEO_IO_DISPATCH_TABLE(DISPATCH_TYPE)
+          case TAG:\
+            detected = getTagFromRawName(#NAME); break;
+          PUEO_IO_DISPATCH_TABLE(DISPATCH_TYPE)
 
+        }
+      }
+      else
+      {
+        std::cerr << "Failed to read packet from " << infiles[0] << std::endl;
       }
+
+      free(packet);
+      pueo_handle_close(&h);
     }
-    else
+
+    if (!detected)
     {
-      std::cerr << "Failed to read packet from " << infiles[0] << std::endl;
+      return -1;
     }
-
-    free(packet);
-    pueo_handle_close(&h);
-
+    o.typetag = detected;
   }
 
   //on second attempt this should be set...
+  const char * typetag = outputs[0].typetag;
   if (!typetag || !*typetag || !strcmp(typetag,"auto"))
   {
     return -1;
@@ -322,7 +1557,7 @@ int pueo::convert::convertFiles(const char * typetag, int nfiles, const char **
 #define CONVERT_TEMPLATE(TAG, RAW, ROOT, POST, ARITY, IMAJOR, IMINOR)\
   else if (!strcmp(typetag,#TAG))\
   {\
-    return converterImpl<ROOT,pueo_##RAW##_t,pueo_read_##RAW,POST, ARITY>(nfiles, infiles, outfile, opts);\
+    return convertProducts<pueo_##RAW##_t,pueo_read_##RAW>(outputs, nfiles, infiles, opts);\
   }
 
   PUEO_CONVERTIBLE_TYPES(CONVERT_TEMPLATE)
@@ -337,12 +1572,12 @@ int pueo::convert::convertFiles(const char * typetag, int nfiles, const char **
 
 #else
 
-int pueo::convert::convertFiles(const char * typetag, int nfiles, const char ** infiles,  const char * outfile, const ConvertOpts & opts)
+int pueo::convert::convertFiles(int noutputs, const ConvertOutput * outputs, int nfiles, const char ** infiles, const ConvertOpts & opts)
 {
-  (void) typetag;
+  (void) noutputs;
+  (void) outputs;
   (void) nfiles;
   (void) infiles;
-  (void) outfile;
   (void) opts;
   std::cerr << "You need to compile with libpueorawdata support to convert files. Sorry." << std::endl;
   return -1;
@@ -351,13 +1586,59 @@ int pueo::convert::convertFiles(const char * typetag, int nfiles, const char **
 
 #endif
 
+
+// "header:10,event" and "a.root,b.root" into outputs, which point into tags and outs
+static bool parseOutputs(const char * typetag, const char * outfile, std::vector<std::string> & tags,
+                         std::vector<std::string> & outs, std::vector<pueo::convert::ConvertOutput> & outputs)
+{
+  tags = splitCommas(typetag);
+  outs = splitCommas(outfile);
+
+  if (tags.size() != outs.size())
+  {
+    std::cerr << tags.size() << " typetag(s) but " << outs.size() << " output file(s)" << std::endl;
+    return false;
+  }
+
+  outputs.resize(tags.size());
+  for (size_t i = 0; i < tags.size(); i++)
+  {
+    size_t colon = tags[i].find(':');
+    if (colon != std::string::npos)
+    {
+      outputs[i].decimate = atoi(tags[i].c_str() + colon + 1);
+      tags[i].resize(colon);
+    }
+    outputs[i].typetag = tags[i].c_str();
+    outputs[i].outfile = outs[i].c_str();
+  }
+  return true;
+}
+
+
+int pueo::convert::convertFiles(const char * typetag, int nfiles, const char ** infiles,  const char * outfile, const ConvertOpts & opts)
+{
+  if (!outfile)
+  {
+    return 0;
+  }
+
+  std::vector<std::string> tags, outs;
+  std::vector<ConvertOutput> outputs;
+  if (!parseOutputs(typetag, outfile, tags, outs, outputs)) return -1;
+
+  return convertFiles(outputs.size(), outputs.data(), nfiles, infiles, opts);
+}
+
+
 static int convert_filter(const struct dirent * d)
 {
   return d->d_name[0]!='.';
 }
 
 
-int pueo::convert::convertFilesOrDirectories(const char * typetag,  int N, const char** in, const char * outfile, const ConvertOpts & opts)
+// expands directories in in[] into their (non-hidden) contents
+static std::vector<char *> expandInputs(int N, const char ** in)
 {
   std::vector<char *> files;
   files.reserve(N);
@@ -409,9 +1690,340 @@ int pueo::convert::convertFilesOrDirectories(const char * typetag,  int N, const
 
   }
 
-  int ret = convertFiles(typetag, files.size(), (const char**) &files[0], outfile, opts);
+  return files;
+}
+
+
+int pueo::convert::convertFilesOrDirectories(const char * typetag,  int N, const char** in, const char * outfile, const ConvertOpts & opts)
+{
+  std::vector<char *> files = expandInputs(N, in);
+  int ret = convertFiles(typetag, files.size(), (const char**) files.data(), outfile, opts);
+  for (auto f : files) free(f);
+
+  return ret;
+}
+
+
+int pueo::convert::convertFilesOrDirectories(int noutputs, const ConvertOutput * outputs, int N, const char** in, const ConvertOpts & opts)
+{
+  std::vector<char *> files = expandInputs(N, in);
+  int ret = convertFiles(noutputs, outputs, files.size(), (const char**) files.data(), opts);
   for (auto f : files) free(f);
 
   return ret;
 }
 
+
+
+/////////////////////////////////////////////////////////////////////////
+// Watching
+
+#ifdef __linux__
+
+// the run number from the last path component like run0123, or -1
+static long runFromPath(const std::string & path)
+{
+  long run = -1;
+  size_t start = 0;
+  while (start < path.size())
+  {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos) end = path.size();
+    if (end - start > 3 && !path.compare(start, 3, "run"))
+    {
+      char * endp = nullptr;
+      long r = strtol(path.c_str() + start + 3, &endp, 10);
+      if (endp == path.c_str() + end) run = r;
+    }
+    start = end + 1;
+  }
+  return run;
+}
+
+
+// outdir/run<RUN>/<base><RUN>[_<part>].root, like pueo-convert-run
+static std::string partPath(const char * outdir, long run, const char * base, int part)
+{
+  std::string path = outdir;
+  if (run >= 0) path += "/run" + std::to_string(run);
+  path += "/";
+  path += base;
+  if (run >= 0) path += std::to_string(run);
+  if (part) path += "_" + std::to_string(part);
+  return path + ".root";
+}
+
+
+static int copyFile(const char * from, const char * to)
+{
+  int in = open(from, O_RDONLY | O_CLOEXEC);
+  if (in < 0) return -1;
+  int out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (out < 0)
+  {
+    close(in);
+    return -1;
+  }
+
+  int ret = 0;
+  std::vector<char> buf(1 << 20);
+  ssize_t n;
+  while ( (n = read(in, buf.data(), buf.size())) > 0)
+  {
+    if (write(out, buf.data(), n) != n)
+    {
+      ret = -1;
+      break;
+    }
+  }
+  if (n < 0) ret = -1;
+  close(in);
+  if (close(out)) ret = -1;
+  return ret;
+}
+
+
+static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+// watch dir and everything under it, queueing files already there
+static void watchTree(int fd, const std::string & dir, std::map<int,std::string> & watched, std::set<std::string> & pending)
+{
+  int wd = inotify_add_watch(fd, dir.c_str(), WATCH_MASK | IN_ONLYDIR);
+  if (wd < 0)
+  {
+    std::cerr << "Couldn't watch " << dir << ": " << strerror(errno) << std::endl;
+    return;
+  }
+  watched[wd] = dir;
+
+  // after adding the watch, so nothing that lands in between is missed
+  struct dirent ** namelist;
+  int n = scandir(dir.c_str(), &namelist, convert_filter, alphasort);
+  for (int i = 0; i < n; i++)
+  {
+    std::string path = dir + "/" + namelist[i]->d_name;
+    struct stat st;
+    if (!stat(path.c_str(), &st))
+    {
+      if (S_ISDIR(st.st_mode)) watchTree(fd, path, watched, pending);
+      else if (S_ISREG(st.st_mode)) pending.insert(path);
+    }
+    free(namelist[i]);
+  }
+  if (n >= 0) free(namelist);
+}
+
+
+int pueo::convert::watchDirectories(int noutputs, const ConvertOutput * outputs, int ndirs, const char ** dirs, const WatchOpts & wopts, const ConvertOpts & opts)
+{
+  if (noutputs <= 0 || !outputs || ndirs <= 0 || !dirs) return 0;
+
+  int fd = inotify_init1(IN_CLOEXEC);
+  if (fd < 0)
+  {
+    std::cerr << "inotify_init1: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  std::map<int,std::string> watched;
+  std::set<std::string> pending; // sorted, so a batch is converted in name order like a directory would be
+  for (int i = 0; i < ndirs; i++) watchTree(fd, dirs[i], watched, pending);
+
+  // the part each output of each run is on
+  std::map<long, std::vector<int>> parts;
+  Long64_t max_bytes = Long64_t(wopts.max_output_mb) << 20;
+  int ntotal = 0;
+  int ret = 0;
+
+  std::map<std::string, Long64_t> converted; // mtime of each input when it was converted, so a rescan skips it
+  std::map<std::string, int> failures;
+  auto last_event = std::chrono::steady_clock::now();
+
+  auto convertPending = [&]()
+  {
+    std::map<long, std::vector<std::string>> by_run;
+    for (const auto & f : pending) by_run[runFromPath(f)].push_back(f);
+    pending.clear();
+
+    for (const auto & run_files : by_run)
+    {
+      long run = run_files.first;
+      std::vector<int> & part = parts[run];
+      mkdir(wopts.outdir, 0755);
+      std::string dir = wopts.outdir + (run >= 0 ? "/run" + std::to_string(run) : std::string());
+      mkdir(dir.c_str(), 0755);
+
+      // pick up where a previous instance left off
+      if (part.empty())
+      {
+        part.resize(noutputs);
+        for (int k = 0; k < noutputs; k++)
+        {
+          while (!access(partPath(wopts.outdir, run, outputs[k].outfile, part[k]+1).c_str(), F_OK)) part[k]++;
+        }
+      }
+
+      // Readers only ever see complete files: convert into a copy of each current part, then rename it over
+      std::vector<std::string> paths(noutputs), work(noutputs), prev(noutputs);
+      std::vector<ConvertOutput> outs(outputs, outputs + noutputs);
+      bool copied = true;
+      for (int k = 0; k < noutputs; k++)
+      {
+        paths[k] = partPath(wopts.outdir, run, outputs[k].outfile, part[k]);
+        work[k] = paths[k] + ".work";
+        unlink(work[k].c_str());
+        if (!access(paths[k].c_str(), F_OK) && copyFile(paths[k].c_str(), work[k].c_str()))
+        {
+          std::cerr << "Couldn't copy " << paths[k] << std::endl;
+          copied = false; // renaming a fresh file over it would lose what's there
+        }
+        outs[k].outfile = work[k].c_str();
+        if (part[k] > 0)
+        {
+          prev[k] = partPath(wopts.outdir, run, outputs[k].outfile, part[k]-1);
+          outs[k].manifest_from = prev[k].c_str();
+        }
+      }
+
+      ConvertOpts append_opts = opts;
+      append_opts.append = true;
+      append_opts.clobber = true;
+
+      std::vector<const char*> infiles;
+      for (const auto & f : run_files.second) infiles.push_back(f.c_str());
+      int n = copied ? convertFiles(noutputs, outs.data(), infiles.size(), infiles.data(), append_opts) : -1;
+
+      // n only counts the first output, so the others may have something new even if it's 0
+      for (int k = 0; k < noutputs; k++)
+      {
+        if (n >= 0 && !rename(work[k].c_str(), paths[k].c_str()))
+        {
+          struct stat st;
+          if (!stat(paths[k].c_str(), &st) && st.st_size > max_bytes) part[k]++;
+        }
+        else
+        {
+          unlink(work[k].c_str());
+        }
+      }
+
+      if (n < 0)
+      {
+        std::cerr << "Failed to convert " << infiles.size() << " file(s) for run " << run << std::endl;
+        ret = -1;
+
+        // try again after the next settle time, up to max_retries times
+        for (const auto & f : run_files.second)
+        {
+          if (++failures[f] <= wopts.max_retries) pending.insert(f);
+          else std::cerr << "Giving up on " << f << std::endl;
+        }
+        last_event = std::chrono::steady_clock::now();
+        continue;
+      }
+
+      for (const auto & f : run_files.second)
+      {
+        struct stat st;
+        if (!stat(f.c_str(), &st)) converted[f] = mtimeOf(st);
+        failures.erase(f);
+      }
+
+      if (n > 0)
+      {
+        std::cout << "Run " << run << ": " << n << " new entries from " << infiles.size() << " file(s)" << std::endl;
+        ntotal += n;
+      }
+    }
+  };
+
+  std::vector<char> buf(1 << 16);
+  while (!(wopts.stop && *wopts.stop))
+  {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int timeout_ms = pending.empty() ? 1000 : std::max(1, int(1000 * wopts.settle));
+    int np = poll(&pfd, 1, timeout_ms);
+    if (np < 0 && errno != EINTR)
+    {
+      std::cerr << "poll: " << strerror(errno) << std::endl;
+      ret = -1;
+      break;
+    }
+
+    if (np > 0)
+    {
+      ssize_t len = read(fd, buf.data(), buf.size());
+      bool overflowed = false;
+      for (ssize_t off = 0; off < len; )
+      {
+        const struct inotify_event * ev = (const struct inotify_event*) (buf.data() + off);
+        off += sizeof(struct inotify_event) + ev->len;
+
+        if (ev->mask & IN_Q_OVERFLOW) overflowed = true;
+        if (!ev->len || ev->name[0] == '.' || !watched.count(ev->wd)) continue;
+        std::string path = watched[ev->wd] + "/" + ev->name;
+
+        if (ev->mask & IN_ISDIR)
+        {
+          if (ev->mask & (IN_CREATE | IN_MOVED_TO)) watchTree(fd, path, watched, pending);
+        }
+        else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+        {
+          // not IN_CREATE: a file is only converted once whoever is writing it is done
+          pending.insert(path);
+        }
+        last_event = std::chrono::steady_clock::now();
+      }
+
+      // events were dropped: look for anything new the way startup does
+      if (overflowed)
+      {
+        std::cerr << "Too many inotify events, rescanning" << std::endl;
+        std::set<std::string> found;
+        for (int i = 0; i < ndirs; i++) watchTree(fd, dirs[i], watched, found);
+        for (const auto & f : found)
+        {
+          struct stat st;
+          auto it = converted.find(f);
+          if (it == converted.end() || stat(f.c_str(), &st) || mtimeOf(st) != it->second) pending.insert(f);
+        }
+        last_event = std::chrono::steady_clock::now();
+      }
+    }
+
+    if (!pending.empty() && std::chrono::steady_clock::now() - last_event >= std::chrono::duration<double>(wopts.settle))
+    {
+      convertPending();
+    }
+  }
+
+  if (!pending.empty()) convertPending();
+  close(fd);
+  return ret < 0 ? ret : ntotal;
+}
+
+#else
+
+int pueo::convert::watchDirectories(int noutputs, const ConvertOutput * outputs, int ndirs, const char ** dirs, const WatchOpts & wopts, const ConvertOpts & opts)
+{
+  (void) noutputs;
+  (void) outputs;
+  (void) ndirs;
+  (void) dirs;
+  (void) wopts;
+  (void) opts;
+  std::cerr << "Watching directories needs inotify, which is Linux only. Sorry." << std::endl;
+  return -1;
+}
+
+#endif
+
+
+int pueo::convert::watchDirectories(const char * typetag, const char * outbase, int ndirs, const char ** dirs, const WatchOpts & wopts, const ConvertOpts & opts)
+{
+  std::vector<std::string> tags, outs;
+  std::vector<ConvertOutput> outputs;
+  if (!outbase || !parseOutputs(typetag, outbase, tags, outs, outputs)) return -1;
+
+  return watchDirectories(outputs.size(), outputs.data(), ndirs, dirs, wopts, opts);
+}
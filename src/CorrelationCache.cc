@@ -0,0 +1,211 @@
+/****************************************************************************************
+*  CorrelationCache.cc            Per-event cache of channel cross-correlations
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/CorrelationCache.h"
+#include "pueo/FFT.h"
+#include "pueo/UsefulEvent.h"
+#include "parallel.h"
+
+#include <cmath>
+#include <algorithm>
+
+
+pueo::CorrelationCache::CorrelationCache(int U)
+  : upsample(std::max(1,U)),
+    L(2 * k::NUM_SAMPLES), // zero-pad to twice the length so the correlation doesn't wrap
+    LU(L * upsample),
+    nf(L/2+1)
+{
+  clear();
+}
+
+
+void pueo::CorrelationCache::clear()
+{
+  ev = nullptr;
+  run = -1;
+  eventNumber = 0;
+  have_spectrum.fill(0);
+  index.clear();
+}
+
+
+void pueo::CorrelationCache::setEvent(const UsefulEvent & e, bool force)
+{
+  if (!force && ev && run == e.runNumber && eventNumber == e.eventNumber)
+  {
+    ev = &e;
+    return;
+  }
+
+  clear();
+  ev = &e;
+  run = e.runNumber;
+  eventNumber = e.eventNumber;
+  for (size_t i = 0; i < k::NUM_RF_CHANNELS; i++)
+  {
+    t0[i] = e.t0[i];
+    dt[i] = e.dt[i];
+  }
+}
+
+
+void pueo::CorrelationCache::computeSpectrum(size_t chan)
+{
+  thread_local std::vector<double> padded;
+  padded.assign(L, 0.);
+  const auto & v = ev->volts[chan];
+  std::copy(v.begin(), v.end(), padded.begin());
+
+  double ss = 0;
+  for (double s : v) ss += s*s;
+  sumsq[chan] = ss;
+
+  spectra[chan].resize(nf);
+  FFT::get(L).forward(&padded[0], &spectra[chan][0]);
+  have_spectrum[chan] = 1;
+}
+
+
+void pueo::CorrelationCache::computeCorrelation(size_t c1, size_t c2, float * out)
+{
+  thread_local std::vector<std::complex<double>> xspec;
+  thread_local std::vector<double> corr;
+
+  const FFT & ifft = FFT::get(LU);
+  xspec.assign(ifft.nfreq(), 0.);
+  corr.resize(LU);
+
+  const std::complex<double> * a = &spectra[c1][0];
+  const std::complex<double> * b = &spectra[c2][0];
+  for (size_t f = 0; f < nf; f++) xspec[f] = a[f] * std::conj(b[f]);
+  ifft.inverse(&xspec[0], &corr[0]);
+
+  // normalize to a correlation coefficient (and undo the 1/U from the longer inverse)
+  const double denom = sqrt(sumsq[c1] * sumsq[c2]);
+  const double scale = denom > 0 ? upsample / denom : 0;
+  for (size_t i = 0; i < LU; i++) out[i] = scale * corr[i];
+}
+
+
+float * pueo::CorrelationCache::allocCorrelation(size_t c1, size_t c2)
+{
+  size_t slot = index.size();
+  index[c1 * k::NUM_RF_CHANNELS + c2] = slot;
+  if (pool.size() <= slot) pool.emplace_back();
+  pool[slot].resize(LU);
+  return &pool[slot][0];
+}
+
+
+void pueo::CorrelationCache::prepareSpectra(const std::vector<Short_t> & chans, int nthreads)
+{
+  if (!ev) return;
+
+  std::vector<Short_t> todo;
+  for (Short_t c : chans)
+  {
+    if (!have_spectrum[c] && std::find(todo.begin(), todo.end(), c) == todo.end()) todo.push_back(c);
+  }
+
+  parallel::forEach(todo.size(), nthreads, [&](size_t i) { computeSpectrum(todo[i]); });
+}
+
+
+void pueo::CorrelationCache::prepare(const std::vector<ChanPair> & pairs, int nthreads)
+{
+  if (!ev) return;
+
+  std::vector<Short_t> chans;
+  chans.reserve(2*pairs.size());
+  for (const auto & p : pairs)
+  {
+    chans.push_back(p.first);
+    chans.push_back(p.second);
+  }
+  prepareSpectra(chans, nthreads);
+
+  // allocate the slots up front (not thread-safe), then fill them in parallel
+  std::vector<std::pair<ChanPair, float*>> todo;
+  for (const auto & p : pairs)
+  {
+    if (findCorrelation(p.first, p.second)) continue;
+    todo.emplace_back(p, allocCorrelation(p.first, p.second));
+  }
+
+  parallel::forEach(todo.size(), nthreads, [&](size_t i)
+  {
+    computeCorrelation(todo[i].first.first, todo[i].first.second, todo[i].second);
+  });
+}
+
+
+const std::complex<double> * pueo::CorrelationCache::getSpectrum(size_t chan)
+{
+  if (!ev || chan >= k::NUM_RF_CHANNELS) return nullptr;
+  if (!have_spectrum[chan]) computeSpectrum(chan);
+  return &spectra[chan][0];
+}
+
+
+const float * pueo::CorrelationCache::findCorrelation(size_t c1, size_t c2) const
+{
+  auto it = index.find(c1 * k::NUM_RF_CHANNELS + c2);
+  return it == index.end() ? nullptr : &pool[it->second][0];
+}
+
+
+const float * pueo::CorrelationCache::getCorrelation(size_t c1, size_t c2)
+{
+  if (!ev || c1 >= k::NUM_RF_CHANNELS || c2 >= k::NUM_RF_CHANNELS) return nullptr;
+  if (const float * found = findCorrelation(c1,c2)) return found;
+
+  getSpectrum(c1);
+  getSpectrum(c2);
+  float * out = allocCorrelation(c1,c2);
+  computeCorrelation(c1,c2,out);
+  return out;
+}
+
+
+double pueo::CorrelationCache::getCorrelationAt(size_t c1, size_t c2, double tau) const
+{
+  const float * corr = findCorrelation(c1,c2);
+  if (!corr)
+  {
+    // the correlation of (c2,c1) is the one of (c1,c2) reversed in lag
+    corr = findCorrelation(c2,c1);
+    if (!corr) return 0;
+    std::swap(c1,c2);
+    tau = -tau;
+  }
+
+  double idx = (tau - getLagOffset(c1,c2)) / getLagStep(c1,c2);
+  double fl = floor(idx);
+  double frac = idx - fl;
+  long j = long(fl) % long(LU);
+  if (j < 0) j += LU;
+  size_t j1 = size_t(j) + 1 == LU ? 0 : j + 1;
+  return (1 - frac) * corr[j] + frac * corr[j1];
+}
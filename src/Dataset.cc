@@ -34,6 +34,7 @@
 #include "pueo/UsefulEvent.h"
 #include "pueo/RawHeader.h"
 #include "pueo/DaqHsk.h"
+#include "pueo/TriggerBits.h"
 #include "pueo/Nav.h"
 #include "pueo/TruthEvent.h" 
 #include "pueo/Version.h" 
@@ -43,6 +44,7 @@
 #include <math.h>
 #include "TFile.h" 
 #include "TTree.h" 
+#include "TBranch.h" 
 #include <stdlib.h>
 #include <unistd.h>
 #include "TMath.h"
@@ -166,13 +168,15 @@ const char * pueo::Dataset::getDataDir(DataDirectory dir)
 pueo::Dataset::Dataset(int run,  DataDirectory version, bool decimated, BlindingStrategy strategy)
   : 
   fHeadTree(0), fHeader(0), 
-  fEventTree(0), fRawEvent(0), fUsefulEvent(0), 
+  fEventTree(0), fRawEvent(0), fUsefulEvent(0), fCompactEvent(0),
   fGpsTree(0), fGps(0), 
   fDaqHskTree(0),fDaqH(0),
   fTruthTree(0), fTruth(0), 
   fCutList(0), fRandy()
 {
   fHaveUsefulFile = false;
+  fHaveCompactFile = false;
+  fCompactDirty = true;
   setStrategy(strategy); 
   currRun = run;
   loadRun(run, version, decimated); 
@@ -283,11 +287,15 @@ bool pueo::Dataset::IsThisPhiPolExcluded(int whichPhi, int whichPol,bool overrid
     if (whichPhi < 1 || whichPhi > 24 || whichPol<0 || whichPol>1) {
       return false;
     }
-    int bit_a = phi_to_bits[whichPhi][0];
-    int bit_b = phi_to_bits[whichPhi][1];
-    bool match_a = IsL2PhiMasked(bit_a,whichPol, override_test,test);
-    bool match_b = IsL2PhiMasked(bit_b,whichPol, override_test,test);
-    return match_a || match_b;
+    // test is in the same sense as gimmePhisExlcudeBits, i.e. already inverted
+    UInt_t enabled = override_test ? ~test : fDaqH->l2_enable_mask;
+    return (triggerbits::excludedPhis(enabled, whichPol) >> (whichPhi-1)) & 1;
+}
+
+UInt_t pueo::Dataset::getExcludedPhis(int pol)
+{
+  if (pol < 0 || pol > 1) return 0;
+  return triggerbits::excludedPhis(daqhsk()->l2_enable_mask, pol);
 }
 
 
@@ -330,6 +338,10 @@ pueo::RawHeader * pueo::Dataset::header(bool force_load)
 pueo::RawEvent * pueo::Dataset::raw(bool force_load) 
 {
   if (!fEventTree) return nullptr; 
+
+  // compact files don't keep the raw data around, so this is the best we can do
+  if (fHaveCompactFile) return useful(force_load); 
+
   if (fEventTree->GetReadEntry() != fWantedEntry || force_load) 
   {
     fEventTree->GetEntry(fWantedEntry); 
@@ -344,7 +356,12 @@ pueo::UsefulEvent * pueo::Dataset::useful(bool force_load)
 
   if (!fEventTree) return nullptr; 
 
-  if (fEventTree->GetReadEntry() != fWantedEntry || force_load) 
+  if (fHaveCompactFile)
+  {
+    // compact() reads the entry and takes care of the polarity
+    compact(force_load); 
+  }
+  else if (fEventTree->GetReadEntry() != fWantedEntry || force_load) 
   {
 
     fEventTree->GetEntry(fWantedEntry); 
@@ -358,14 +375,22 @@ pueo::UsefulEvent * pueo::Dataset::useful(bool force_load)
       fUsefulEvent = new UsefulEvent; 
     }
 
-    fUsefulEvent->~UsefulEvent();
-    new (fUsefulEvent) UsefulEvent(*fRawEvent, *header()); 
+    if (fHaveCompactFile) 
+    {
+      fCompactEvent->toUseful(*fUsefulEvent); 
+    }
+    else
+    {
+      fUsefulEvent->~UsefulEvent();
+      new (fUsefulEvent) UsefulEvent(*fRawEvent, *header()); 
+    }
     fUsefulDirty = false; 
   }
 
   // This is the blinding implementation for the header
+  // (compact() already did it, before inverting the polarity, for compact files)
 
-  if(theStrat & kInsertedVPolEvents){
+  if(!fHaveCompactFile && (theStrat & kInsertedVPolEvents)){
     Int_t fakeTreeEntry = needToOverwriteEvent(pol::kVertical, fUsefulEvent->eventNumber);
     if(fakeTreeEntry > -1){
       overwriteEvent(fUsefulEvent, pol::kVertical, fakeTreeEntry);
@@ -373,7 +398,7 @@ pueo::UsefulEvent * pueo::Dataset::useful(bool force_load)
   }
 
 
-  if(theStrat & kInsertedHPolEvents){
+  if(!fHaveCompactFile && (theStrat & kInsertedHPolEvents)){
     Int_t fakeTreeEntry = needToOverwriteEvent(pol::kHorizontal, fUsefulEvent->eventNumber);
     if(fakeTreeEntry > -1){
       overwriteEvent(fUsefulEvent, pol::kHorizontal, fakeTreeEntry);
@@ -381,7 +406,7 @@ pueo::UsefulEvent * pueo::Dataset::useful(bool force_load)
   }
 
 
-  if ((theStrat & kRandomizePolarity) && maybeInvertPolarity(fUsefulEvent->eventNumber))
+  if (!fHaveCompactFile && (theStrat & kRandomizePolarity) && maybeInvertPolarity(fUsefulEvent->eventNumber))
   {
     // std::cerr << "Inverting event " << fUsefulEvent->eventNumber << std::endl;
     for(int ichan=0; ichan < k::NUM_DIGITIZED_CHANNELS; ichan++)
@@ -397,6 +422,57 @@ pueo::UsefulEvent * pueo::Dataset::useful(bool force_load)
   return fUsefulEvent;
 }
 
+pueo::CompactUsefulEvent * pueo::Dataset::compact(bool force_load, CompactUsefulEvent::Precision precision) 
+{
+  if (!fEventTree) return nullptr; 
+
+  if (fHaveCompactFile) 
+  {
+    if (fEventTree->GetReadEntry() != fWantedEntry || force_load) 
+    {
+      fEventTree->GetEntry(fWantedEntry);
+      fUsefulDirty = true;
+      overwriteCompact(fCompactEvent);
+
+      // only right after reading: inverting the event in memory again would undo it
+      if ((theStrat & kRandomizePolarity) && maybeInvertPolarity(fCompactEvent->eventNumber))
+      {
+        fCompactEvent->invertPolarity();
+      }
+    }
+
+    // the stored precision is whatever the producer chose
+    fCompactDirty = false;
+    return fCompactEvent;
+  }
+
+  if (fCompactDirty || force_load || !fCompactEvent || fCompactEvent->getPrecision() != precision)
+  {
+    if (!fCompactEvent) 
+    {
+      fCompactEvent = new CompactUsefulEvent; 
+    }
+
+    if (fHaveUsefulFile) 
+    {
+      //useful() already takes care of blinding 
+      *fCompactEvent = CompactUsefulEvent(*useful(force_load), precision); 
+    }
+    else
+    {
+      *fCompactEvent = CompactUsefulEvent(*raw(force_load), *header(), precision); 
+      overwriteCompact(fCompactEvent);
+      if ((theStrat & kRandomizePolarity) && maybeInvertPolarity(fCompactEvent->eventNumber))
+      {
+        fCompactEvent->invertPolarity(); 
+      }
+    }
+    fCompactDirty = false; 
+  }
+
+  return fCompactEvent; 
+}
+
 // Calling this function on it's own is just for unblinding, please use honestly
 Bool_t pueo::Dataset::maybeInvertPolarity(UInt_t eventNumber){
   // add additional check here for clarity, in case people call this function on it's own?
@@ -420,19 +496,15 @@ bool pueo::Dataset::IsL2PhiBitSet(int pol, int L2bit, bool override_test,UInt_t
 
 bool pueo::Dataset::IsPolPhiTriggered(int pol, int phi, bool override_test, UInt_t test){
   if (phi < 1 || phi > 24) return false;
-  int bit_a = -1;
-  int bit_b = -1;
-  if (pol == 0) {
-    bit_a = pol0_to_bits[phi][0];
-    bit_b = pol0_to_bits[phi][1];
-  }
-  else if (pol == 1) {
-    // Subtracting 12 normalizes the global bits (12-23) down to local bits (0-11)
-    bit_a = pol1_to_bits[phi][0] - 12;
-    bit_b = pol1_to_bits[phi][1] - 12;
-  }
-  else return false; // Invalid pol
-  return IsL2PhiBitSet(pol, bit_a,override_test,test) || IsL2PhiBitSet(pol, bit_b,override_test,test);
+  if (pol != 0 && pol != 1) return false; // Invalid pol
+  UInt_t mask = override_test ? test : fHeader->L2Mask;
+  return (triggerbits::triggeredPhis(mask, pol) >> (phi-1)) & 1;
+}
+
+UInt_t pueo::Dataset::getTriggeredPhis(int pol)
+{
+  if (pol != 0 && pol != 1) return 0;
+  return triggerbits::triggeredPhis(header()->L2Mask, pol);
 }
 
 int pueo::Dataset::getEntry(int entryNumber)
@@ -457,6 +529,7 @@ int pueo::Dataset::getEntry(int entryNumber)
 
     }
     if (!fHaveUsefulFile) fUsefulDirty = true; 
+    fCompactDirty = true; 
     if (!fHaveGpsEvent) fGpsDirty = true; 
   }
 
@@ -502,6 +575,9 @@ pueo::Dataset::~Dataset()
     delete fUsefulEvent; 
   }
 
+  if (fCompactEvent) 
+    delete fCompactEvent; 
+
   if (fRawEvent) 
     delete fRawEvent; 
 
@@ -703,8 +779,21 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
   {
      filesToClose.push_back(f); 
      fEventTree = (TTree*) f->Get("eventTree"); 
-     fHaveUsefulFile = true; 
-     fEventTree->SetBranchAddress("event",&fUsefulEvent); 
+
+     // MC producers may have written only the compact representation
+     TBranch * b = fEventTree->GetBranch("event"); 
+     if (b && !strcmp(b->GetClassName(),"pueo::CompactUsefulEvent"))
+     {
+       fHaveCompactFile = true; 
+       fHaveUsefulFile = false; 
+       fEventTree->SetBranchAddress("event",&fCompactEvent); 
+     }
+     else
+     {
+       fHaveCompactFile = false; 
+       fHaveUsefulFile = true; 
+       fEventTree->SetBranchAddress("event",&fUsefulEvent); 
+     }
   }
   else 
   {
@@ -714,6 +803,7 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
        filesToClose.push_back(f); 
        fEventTree = (TTree*) f->Get("eventTree"); 
        fHaveUsefulFile = false; 
+       fHaveCompactFile = false; 
        fEventTree->SetBranchAddress("event",&fRawEvent); 
     }
   }
@@ -1201,6 +1291,24 @@ void pueo::Dataset::overwriteHeader(RawHeader* header, pol::pol_t pol, Int_t fak
 
 }
 
+/**
+ * The inserted-event blinding for compact events: swaps in the fake event, at the compact event's precision
+ */
+void pueo::Dataset::overwriteCompact(CompactUsefulEvent* compact){
+
+  for (pol::pol_t pol : {pol::kVertical, pol::kHorizontal}){
+    if(!(theStrat & (pol == pol::kVertical ? kInsertedVPolEvents : kInsertedHPolEvents))) continue;
+
+    Int_t fakeTreeEntry = needToOverwriteEvent(pol, compact->eventNumber);
+    if(fakeTreeEntry > -1){
+      UsefulEvent useful;
+      useful.eventNumber = compact->eventNumber;
+      overwriteEvent(&useful, pol, fakeTreeEntry);
+      *compact = CompactUsefulEvent(useful, compact->getPrecision());
+    }
+  }
+}
+
 void pueo::Dataset::overwriteEvent(UsefulEvent* useful, pol::pol_t pol, Int_t fakeTreeEntry){
 
   Int_t numBytes = fBlindEventTree[pol]->GetEntry(fakeTreeEntry);
@@ -0,0 +1,92 @@
+/****************************************************************************************
+*  EventGraphs.cc            Reusable per-channel graphs for event displays
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/EventGraphs.h"
+#include "pueo/UsefulEvent.h"
+#include "pueo/GeomTool.h"
+
+#include "TGraph.h"
+#include "TAxis.h"
+
+
+pueo::EventGraphs::EventGraphs()
+{
+  const GeomTool & geom = GeomTool::Instance();
+  for (size_t ichan = 0; ichan < graphs.size(); ichan++)
+  {
+    int ant;
+    pol::pol_t pol;
+    geom.getAntPolFromChanIndex(ichan,ant,pol);
+
+    TGraph * g = new TGraph(k::NUM_SAMPLES);
+    g->SetName(Form("ant%d%c", ant, pol::asChar(pol)));
+    g->SetTitle(Form("Antenna %d%c", ant, pol::asChar(pol)));
+    g->GetXaxis()->SetTitle("t [ns]");
+    g->GetYaxis()->SetTitle("V [mV]");
+    g->SetBit(TGraph::kIsSortedX);
+    g->SetBit(TGraph::kNotEditable);
+    graphs[ichan] = g;
+  }
+}
+
+
+pueo::EventGraphs::~EventGraphs()
+{
+  for (auto g : graphs) delete g;
+}
+
+
+void pueo::EventGraphs::update(const UsefulEvent & ev)
+{
+  for (size_t ichan = 0; ichan < graphs.size(); ichan++) ev.fillGraph(ichan, graphs[ichan]);
+  eventNumber = ev.eventNumber;
+}
+
+
+void pueo::EventGraphs::update(const UsefulEvent & ev, size_t chanIndex)
+{
+  ev.fillGraph(chanIndex, get(chanIndex));
+  eventNumber = ev.eventNumber;
+}
+
+
+TGraph * pueo::EventGraphs::get(int ant, pol::pol_t pol) const
+{
+  int idx = GeomTool::Instance().getChanIndexFromAntPol(ant,pol);
+  return idx < 0 ? nullptr : get(size_t(idx));
+}
+
+
+TGraph * pueo::EventGraphs::get(ring::ring_t ring, int phi, pol::pol_t pol) const
+{
+  int idx = GeomTool::Instance().getChanIndexFromRingPhiPol(ring,phi,pol);
+  return idx < 0 ? nullptr : get(size_t(idx));
+}
+
+
+TGraph * pueo::EventGraphs::get(int surf, int chan) const
+{
+  int idx = GeomTool::Instance().getChanIndex(surf,chan);
+  return idx < 0 ? nullptr : get(size_t(idx));
+}
@@ -0,0 +1,127 @@
+/****************************************************************************************
+*  FFT.cc            Real FFTs with cached FFTW plans
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/FFT.h"
+
+#include "TMutex.h"
+
+#include <fftw3.h>
+#include <map>
+#include <cstring>
+
+
+static TMutex fft_lock;
+static std::map<size_t, pueo::FFT*> ffts;
+
+
+namespace
+{
+  // fftw_malloc'd buffers have the alignment the plans were made with, which is
+  // what the new-array execute functions require
+  struct Scratch
+  {
+    size_t n = 0;
+    double * real = nullptr;
+    fftw_complex * cplx = nullptr;
+
+    void reserve(size_t N)
+    {
+      if (N <= n) return;
+      fftw_free(real);
+      fftw_free(cplx);
+      real = fftw_alloc_real(N);
+      cplx = fftw_alloc_complex(N/2+1);
+      n = N;
+    }
+
+    ~Scratch() { fftw_free(real); fftw_free(cplx); }
+  };
+
+  thread_local Scratch scratch;
+}
+
+
+const pueo::FFT & pueo::FFT::get(size_t N)
+{
+  // hot path: same length as last time on this thread
+  thread_local const FFT * last = nullptr;
+  if (last && last->N == N) return *last;
+
+  TLockGuard l(&fft_lock);
+  FFT *& fft = ffts[N];
+  if (!fft) fft = new FFT(N);
+  last = fft;
+  return *fft;
+}
+
+
+pueo::FFT::FFT(size_t n)
+  : N(n)
+{
+  // called with fft_lock held
+  double * r = fftw_alloc_real(N);
+  fftw_complex * c = fftw_alloc_complex(N/2+1);
+  fwd_plan = fftw_plan_dft_r2c_1d(N, r, c, FFTW_MEASURE);
+  inv_plan = fftw_plan_dft_c2r_1d(N, c, r, FFTW_MEASURE);
+  fftw_free(r);
+  fftw_free(c);
+}
+
+
+void pueo::FFT::forward(const double * in, std::complex<double> * out) const
+{
+  scratch.reserve(N);
+  memcpy(scratch.real, in, N * sizeof(double));
+  fftw_execute_dft_r2c((fftw_plan) fwd_plan, scratch.real, scratch.cplx);
+  memcpy((void*) out, scratch.cplx, nfreq() * sizeof(fftw_complex));
+}
+
+
+void pueo::FFT::inverse(const std::complex<double> * in, double * out) const
+{
+  scratch.reserve(N);
+  memcpy(scratch.cplx, (const void*) in, nfreq() * sizeof(fftw_complex));
+  fftw_execute_dft_c2r((fftw_plan) inv_plan, scratch.cplx, scratch.real);
+  const double norm = 1./N;
+  for (size_t i = 0; i < N; i++) out[i] = scratch.real[i] * norm;
+}
+
+
+void pueo::FFT::power(const double * in, double * psd, double dt) const
+{
+  scratch.reserve(N);
+  memcpy(scratch.real, in, N * sizeof(double));
+  fftw_execute_dft_r2c((fftw_plan) fwd_plan, scratch.real, scratch.cplx);
+
+  const size_t nf = nfreq();
+  const double norm = dt / N;
+  for (size_t i = 0; i < nf; i++)
+  {
+    const double re = scratch.cplx[i][0];
+    const double im = scratch.cplx[i][1];
+    // double everything but DC (and Nyquist, for even N) to fold in the negative frequencies
+    const bool single = i == 0 || (N % 2 == 0 && i == nf-1);
+    psd[i] = (single ? norm : 2*norm) * (re*re + im*im);
+  }
+}
@@ -31,6 +31,10 @@
 #include <iostream>
 #include <fstream>
 #include "TMutex.h" 
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <cmath>
 
 #define R_EARTH 6.378137E6
 #define  GEOID_MAX 6.378137E6 // parameters of geoid model
@@ -60,6 +64,156 @@ pueo::GeomTool::GeomTool(int v, const std::string & src)
   fPitchRotationAxis.SetXYZ(0.,1.,0.);
   fRollRotationAxis=fPitchRotationAxis.Cross(fHeadingRotationAxis);
   aftForeOffsetAngleVertical=TMath::DegToRad()*45;
+  buildTables(); 
+}
+
+
+static inline double wrapTwoPi(double phi) 
+{
+  phi = fmod(phi, TMath::TwoPi()); 
+  return phi < 0 ? phi + TMath::TwoPi() : phi; 
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Asks the geometry reader about everything once, so that all the lookups below are just array 
+/// accesses. Geometries are only known at runtime (they're read from pueo-data), so this can't be constexpr. 
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+void pueo::GeomTool::buildTables() 
+{
+  ChanInfo none; 
+  chanInfo.fill(none); 
+  chanFromSurfChan.fill(-1); 
+  for (auto & a : chanFromAntPol) a.fill(-1); 
+  for (auto & phi : chanFromPhiRingPol) for (auto & ring : phi) ring.fill(-1); 
+  antPhasePhi = {}; 
+  antPhaseCenter = {}; 
+
+  int nfound = 0; 
+  for (int i = 0; i < k::NUM_DIGITIZED_CHANNELS; i++) 
+  {
+    auto ch = r.fromGlobal(i); 
+    if (!ch) continue; 
+    int idx = ch->globalChannel; 
+    if (idx < 0 || idx >= k::NUM_DIGITIZED_CHANNELS) continue; 
+
+    ChanInfo & info = chanInfo[idx]; 
+    info.surf = ch->surfNum; 
+    info.chan = ch->surfChan; 
+    info.ant = ch->antIdx; 
+    info.pol = pol::fromChar(ch->pol); 
+    info.ring = ring::fromIdx(ch->ring); 
+    info.phi = ch->phiSector; 
+    nfound++; 
+
+    if (info.surf >= 0 && info.surf < MAX_SURF && info.chan >= 0 && info.chan < k::NUM_CHANS_PER_SURF) 
+      chanFromSurfChan[info.surf * k::NUM_CHANS_PER_SURF + info.chan] = idx; 
+
+    if (info.pol == pol::kNotAPol) continue; 
+
+    if (info.ant >= 0 && info.ant < k::NUM_ANTS) 
+    {
+      chanFromAntPol[info.ant][info.pol] = idx; 
+      auto & pos = antPhaseCenter[info.ant][info.pol]; 
+      pos[0] = ch->geom.face_center.x; 
+      pos[1] = ch->geom.face_center.y; 
+      pos[2] = ch->geom.face_center.z; 
+      antPhasePhi[info.ant][info.pol] = ch->geom.phase_phi(); 
+    }
+
+    if (info.phi >= 0 && info.phi <= k::NUM_PHI && ch->ring >= 0 && ch->ring < ring::kNotARing) 
+      chanFromPhiRingPol[info.phi][ch->ring][info.pol] = idx; 
+  }
+  valid = nfound > 0; 
+
+  // and the per-antenna arrays. The reader only knows face centres, so those stand in for the phase centres too. 
+  for (int ant = 0; ant < k::NUM_ANTS; ant++) 
+  {
+    for (int ipol = 0; ipol < k::NUM_POLS; ipol++) 
+    {
+      if (chanFromAntPol[ant][ipol] < 0) continue; 
+      const auto & pos = antPhaseCenter[ant][ipol]; 
+      double r = sqrt(pos[0]*pos[0] + pos[1]*pos[1]); 
+      if (ant < k::NUM_HORNS) 
+      {
+        xPhaseCenterHorns[ant][ipol] = pos[0]; 
+        yPhaseCenterHorns[ant][ipol] = pos[1]; 
+        zPhaseCenterHorns[ant][ipol] = pos[2]; 
+        rPhaseCenterHorns[ant][ipol] = r; 
+        azPhaseCenterHorns[ant][ipol] = antPhasePhi[ant][ipol]; 
+      }
+      else 
+      {
+        int lf = ant - k::NUM_HORNS; 
+        xPhaseCenterLF[lf][ipol] = pos[0]; 
+        yPhaseCenterLF[lf][ipol] = pos[1]; 
+        zPhaseCenterLF[lf][ipol] = pos[2]; 
+        rPhaseCenterLF[lf][ipol] = r; 
+        azPhaseCenterLF[lf][ipol] = antPhasePhi[ant][ipol]; 
+      }
+    }
+
+    // faces are the same for both pols, prefer V 
+    int ipol = chanFromAntPol[ant][pol::kVertical] >= 0 ? pol::kVertical : pol::kHorizontal; 
+    if (chanFromAntPol[ant][ipol] < 0) continue; 
+    const auto & pos = antPhaseCenter[ant][ipol]; 
+    double r = sqrt(pos[0]*pos[0] + pos[1]*pos[1]); 
+    double az = atan2(pos[1], pos[0]); 
+    if (az < 0) az += TMath::TwoPi(); 
+    if (ant < k::NUM_HORNS) 
+    {
+      xAntHorns[ant] = pos[0]; 
+      yAntHorns[ant] = pos[1]; 
+      zAntHorns[ant] = pos[2]; 
+      rAntHorns[ant] = r; 
+      azCenterAntHorns[ant] = az; 
+    }
+    else 
+    {
+      int lf = ant - k::NUM_HORNS; 
+      xAntLF[lf] = pos[0]; 
+      yAntLF[lf] = pos[1]; 
+      zAntLF[lf] = pos[2]; 
+      rAntLF[lf] = r; 
+      azCenterAntLF[lf] = az; 
+    }
+  }
+
+  // sorted top-ring azimuths for the nearest-antenna lookups 
+  auto fillAz = [this](AzTable & t, const std::function<double(int)> & az, int ipol)
+  {
+    std::vector<std::pair<double,Short_t>> v; 
+    for (int ant = 0; ant < k::NUM_ANTS; ant++) 
+    {
+      if (chanFromAntPol[ant][ipol] < 0 || chanInfo[chanFromAntPol[ant][ipol]].ring != ring::kTopRing) continue; 
+      v.emplace_back(wrapTwoPi(az(ant)), ant); 
+    }
+    std::sort(v.begin(), v.end()); 
+    t.az.clear(); 
+    t.ant.clear(); 
+    for (const auto & e : v) 
+    {
+      t.az.push_back(e.first); 
+      t.ant.push_back(e.second); 
+    }
+  }; 
+
+  for (int ipol = 0; ipol < k::NUM_POLS; ipol++) 
+    fillAz(topPhaseAz[ipol], [&](int ant) { return antPhasePhi[ant][ipol]; }, ipol); 
+  fillAz(topFaceAz, [&](int ant) { return getAntFacePhiPosition(ant); }, pol::kHorizontal); 
+}
+
+
+int pueo::GeomTool::AzTable::nearest(double phi) const 
+{
+  size_t n = az.size(); 
+  if (!n) return -1; 
+  size_t i = std::upper_bound(az.begin(), az.end(), phi) - az.begin(); 
+  size_t lo = i == 0 ? n-1 : i-1; 
+  size_t hi = i == n ? 0 : i; 
+  double dlo = i == 0 ? phi - az[lo] + TMath::TwoPi() : phi - az[lo]; 
+  double dhi = i == n ? az[hi] + TMath::TwoPi() - phi : az[hi] - phi; 
+  return dlo <= dhi ? lo : hi; 
 }
 
 
@@ -68,12 +222,12 @@ pueo::GeomTool::GeomTool(int v, const std::string & src)
 Int_t pueo::GeomTool::getPhiRingPolFromSurfChan(Int_t surf,Int_t chan, Int_t &phi,
 						      ring::ring_t &ring,pol::pol_t &pol) const
 {
-  auto ch = r.fromSurf(surf,chan); 
+  const ChanInfo * ch = info(getChanIndex(surf,chan)); 
   if (!ch) return -1; 
 
-  phi = ch->phiSector; 
+  phi = ch->phi; 
   ring = ring::ring_t(ch->ring); 
-  pol = pol::fromChar(ch->pol); 
+  pol = pol::pol_t(ch->pol); 
   return phi;
 }
 
@@ -82,11 +236,11 @@ Int_t pueo::GeomTool::getPhiRingPolFromSurfChan(Int_t surf,Int_t chan, Int_t &ph
 
 Int_t pueo::GeomTool::getSurfChanAntFromRingPhiPol(ring::ring_t ring,Int_t phi, pol::pol_t pol ,Int_t &surf, Int_t &chan, Int_t &ant) const  {
 
-  auto ch = r.fromPhiRingPol(phi,ring, pol::asChar(pol)); 
-  if (!ch) return -1; 
-  chan = ch->surfChan; 
-  surf = ch->surfNum; 
-  ant = ch->antIdx; 
+  const ChanInfo * ch = info(getChanIndexFromRingPhiPol(ring,phi,pol)); 
+  if (!ch || ch->ant < 0) return -1; 
+  chan = ch->chan; 
+  surf = ch->surf; 
+  ant = ch->ant; 
   return surf;
 }
 
@@ -99,7 +253,10 @@ Int_t pueo::GeomTool::getSurfChanAntFromRingPhiPol(ring::ring_t ring,Int_t phi,
 static TMutex instance_lock; 
 static std::unordered_map<std::string,pueo::GeomTool*> instances[pueo::k::NUM_PUEO]; 
 static std::array<std::string, pueo::k::NUM_PUEO> default_sources = { "jan26", }; 
-static std::string empty (""); 
+
+// bumped whenever a default changes, so that per-thread caches of the default instance know to look again 
+static std::atomic<unsigned> default_generation(0); 
+
 void pueo::GeomTool::setDefaultGeometry(Int_t v, const std::string & src) 
 {
   v = v ?: version::get(); 
@@ -107,24 +264,47 @@ void pueo::GeomTool::setDefaultGeometry(Int_t v, const std::string & src)
   {
     TLockGuard l(&instance_lock); 
     default_sources[v-1] = src; 
+    default_generation++; 
   }
 
 }
 
-const std::string & pueo::GeomTool::getDefaultGeometry(Int_t v) 
+std::string pueo::GeomTool::getDefaultGeometry(Int_t v) 
 {
   
   v = v ?: version::get(); 
   if (v <= k::NUM_PUEO) 
   {
+    // a copy, since setDefaultGeometry may change it from another thread 
+    TLockGuard l(&instance_lock); 
     return default_sources[v-1]; 
   }
-  return empty; 
+  return ""; 
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+/// Finds (or makes) the instance for a version and source. Everything is done holding the lock, 
+/// instances are never deleted, so the pointer is good forever. 
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+const pueo::GeomTool * pueo::GeomTool::getHandle(Int_t v, const char *  geometry_source )
+{
+  if (v < 0 || v > k::NUM_PUEO) v = 0; 
+  if (!v) v = version::get(); 
+
+  TLockGuard l(&instance_lock); 
+  const std::string & p = geometry_source == 0 || geometry_source[0] == 0 ? default_sources[v-1] : std::string(geometry_source); 
+  GeomTool *& g = instances[v-1][p]; 
+  if (!g) 
+  {
+    std::cout << "Generating instance with v= " << v << " source = " << p << std::endl; 
+    g = new pueo::GeomTool(v, p); 
+  }
+  return g; 
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 /// Generates an instance of pueo::GeomTool, required for non-static functions.
-//TODO:  unordered_map is slow and I make a copy... 
+/// The last instance used is remembered per thread, so repeated calls are just a comparison. 
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 const pueo::GeomTool&  pueo::GeomTool::Instance(Int_t v, const char *  geometry_source )
 {
@@ -132,31 +312,71 @@ const pueo::GeomTool&  pueo::GeomTool::Instance(Int_t v, const char *  geometry_
   if (v < 0 || v > k::NUM_PUEO) v = 0; 
   if (!v) v = version::get(); 
 
+  if (geometry_source == 0 || geometry_source[0] == 0) 
+  {
+    thread_local const GeomTool * last = nullptr; 
+    thread_local int last_v = 0; 
+    thread_local unsigned last_generation = 0; 
 
-  std::string  p = geometry_source == 0 || geometry_source[0] == 0 ? getDefaultGeometry(v) : geometry_source; 
+    // if the default changes between reading the generation and resolving, we just look again next time
+    unsigned generation = default_generation.load(std::memory_order_acquire); 
+    if (!last || last_v != v || last_generation != generation) 
+    {
+      last = getHandle(v, ""); 
+      last_v = v; 
+      last_generation = generation; 
+    }
+    return *last; 
+  }
 
-  if (!instances[v-1].count(p)) 
+  thread_local const GeomTool * last_named = nullptr; 
+  thread_local int last_named_v = 0; 
+  thread_local std::string last_named_source; 
+  if (!last_named || last_named_v != v || last_named_source != geometry_source) 
   {
-    instance_lock.Lock(); 
-    //check again while holding lock 
-    if (!instances[v-1].count(p))
+    last_named = getHandle(v, geometry_source); 
+    last_named_v = v; 
+    last_named_source = geometry_source; 
+  }
+  return *last_named; 
+}
+
+
+
+static TMutex chanmap_lock; 
+static std::unordered_map<const pueo::GeomTool*, std::array<Short_t,pueo::k::NUM_RF_CHANNELS>*> chanmaps; 
+
+const std::array<Short_t,pueo::k::NUM_RF_CHANNELS> & pueo::GeomTool::getDataChanMap() const
+{
+  // almost everyone only ever uses one geometry, so remember the last one per thread 
+  thread_local const GeomTool * last_geom = nullptr; 
+  thread_local const std::array<Short_t,k::NUM_RF_CHANNELS> * last_map = nullptr; 
+  if (last_geom == this) return *last_map; 
+
+  TLockGuard l(&chanmap_lock); 
+  auto & m = chanmaps[this]; 
+  if (!m) 
+  {
+    const GeomTool & flight_geom = Instance(0,"flight"); 
+    m = new std::array<Short_t,k::NUM_RF_CHANNELS>; 
+    for (int ichan = 0; ichan < k::NUM_RF_CHANNELS; ichan++) 
     {
-      std::cout << "Generating instance with v= " << v << " source = " << p << std::endl; 
-      instances[v-1][p] = new pueo::GeomTool(v, p); 
+      int ant = -1; 
+      pol::pol_t pol = pol::kNotAPol; 
+      (*m)[ichan] = getAntPolFromChanIndex(ichan, ant, pol) < 0 ? -1 : flight_geom.getChanIndexFromAntPol(ant,pol); 
     }
-    instance_lock.UnLock(); 
   }
 
-  return *(instances[v-1][p]);
+  last_geom = this; 
+  last_map = m; 
+  return *m; 
 }
 
 
-
 Int_t pueo::GeomTool::getChanIndex(Int_t surf, Int_t chan) const{
 
-  auto ch =  r.fromSurf(surf,chan);
-  if (!ch) return -1;
-  return ch->globalChannel; 
+  if (surf < 0 || surf >= MAX_SURF || chan < 0 || chan >= k::NUM_CHANS_PER_SURF) return -1; 
+  return chanFromSurfChan[surf * k::NUM_CHANS_PER_SURF + chan]; 
 }
 
 
@@ -176,9 +396,8 @@ Int_t pueo::GeomTool::getChanIndexFromRingPhiPol(ring::ring_t ring,
 					      Int_t phi,
 					      pol::pol_t pol) const
 {
-  auto ch = r.fromPhiRingPol(phi,ring, pol::asChar(pol)); 
-  if (!ch) return -1; 
-  return ch->globalChannel; 
+  if (phi < 0 || phi > k::NUM_PHI || ring < 0 || ring >= ring::kNotARing || pol < 0 || pol >= k::NUM_POLS) return -1; 
+  return chanFromPhiRingPol[phi][ring][pol]; 
 }
 
 
@@ -186,9 +405,8 @@ Int_t pueo::GeomTool::getChanIndexFromAntPol(Int_t ant,
 					  pol::pol_t pol) const
 {
 
-  auto ch = r.fromAntIdxPol(ant, pol::asChar(pol)); 
-  if (!ch) return -1; 
-  return ch->globalChannel; 
+  if (ant < 0 || ant >= k::NUM_ANTS || pol < 0 || pol >= k::NUM_POLS) return -1; 
+  return chanFromAntPol[ant][pol]; 
 }
 
 Int_t pueo::GeomTool::getSurfFromAntPol(Int_t ant, pol::pol_t pol) const
@@ -200,23 +418,18 @@ Int_t pueo::GeomTool::getSurfFromAntPol(Int_t ant, pol::pol_t pol) const
 Int_t pueo::GeomTool::getSurfChanFromAntPol(Int_t ant, pol::pol_t pol, Int_t & surf, Int_t & chan) const
 {
 
-  auto ch = r.fromAntIdxPol(ant, pol::asChar(pol)); 
-  if (!ch) return -1; 
-  surf = ch->surfNum;
-  chan = ch->surfChan; 
+  const ChanInfo * ch = info(getChanIndexFromAntPol(ant,pol)); 
+  if (!ch || ch->ant < 0) return -1; 
+  surf = ch->surf;
+  chan = ch->chan; 
   return surf; 
 }
 
 
 Int_t pueo::GeomTool::getPhiSector(Int_t chanIndex) const
 {
-  int surf, chan; 
-  getSurfChanFromChanIndex(chanIndex,surf,chan); 
-  int phi; 
-  ring::ring_t ring; 
-  pol::pol_t pol; 
-  getPhiRingPolFromSurfChan(surf,chan,phi,ring,pol); 
-  return phi; 
+  const ChanInfo * ch = info(chanIndex); 
+  return ch ? ch->phi : -1; 
 }
 
 
@@ -241,37 +454,51 @@ Double_t pueo::GeomTool::getDirectionWrtNorth(Int_t phiSector, Double_t heading)
 
 }
 
+void pueo::GeomTool::getDirectionWrtNorth(const Int_t * phiSector, const Double_t * heading, size_t n, Double_t * direction) const 
+{
+  const double offset = aftForeOffsetAngleVertical*TMath::RadToDeg(); 
+  const double dphi = 360./k::NUM_PHI; 
+  for (size_t i = 0; i < n; i++) 
+  {
+    double d = heading[i] + offset - phiSector[i] * dphi; 
+    d -= 360 * (d >= 360); 
+    d += 360 * (d < 0); 
+    bool ok = phiSector[i] >= 0 && phiSector[i] < k::NUM_PHI; 
+    direction[i] = ok ? d : -1.; 
+  }
+}
+
 
 
 Int_t pueo::GeomTool::getSurfChanFromChanIndex(Int_t chanIndex, // input channel index
 					    Int_t &surf,Int_t &chan) const // output surf and channel
 {
-  auto ch = r.fromGlobal(chanIndex); 
+  const ChanInfo * ch = info(chanIndex); 
   if (!ch) return -1; 
-  chan = ch->surfChan; 
-  surf = ch->surfNum; 
+  chan = ch->chan; 
+  surf = ch->surf; 
   return surf;
 
 }
 Int_t pueo::GeomTool::getAntPolFromChanIndex(Int_t chanIndex,Int_t &ant, pol::pol_t &pol) const
 {
 
-  auto ch = r.fromGlobal(chanIndex); 
+  const ChanInfo * ch = info(chanIndex); 
   if (!ch) return -1; 
 
-  ant = ch->antIdx; 
-  pol = pol::fromChar(ch->pol); 
+  ant = ch->ant; 
+  pol = pol::pol_t(ch->pol); 
   return ant; 
 }
 
 
 Int_t pueo::GeomTool::getAntPolFromSurfChan(Int_t surf,Int_t chan,Int_t &ant, pol::pol_t &pol) const
 {
-  auto ch = r.fromSurf(surf,chan); 
+  const ChanInfo * ch = info(getChanIndex(surf,chan)); 
   if (!ch) return -1; 
 
-  ant = ch->antIdx; 
-  pol = pol::fromChar(ch->pol); 
+  ant = ch->ant; 
+  pol = pol::pol_t(ch->pol); 
   return ant; 
 }
 
@@ -282,9 +509,10 @@ Int_t pueo::GeomTool::getAntOrientation(Int_t ant) const {
 
 pueo::ring::ring_t pueo::GeomTool::getRingFromAnt(Int_t ant) const {
 
-  auto ch = r.fromAntIdxPol(ant); 
-  if (!ch) return ring::kNotARing; 
-  return ring::fromIdx(ch->ring); 
+  const ChanInfo * ch = info(getChanIndexFromAntPol(ant, pol::kVertical)); 
+  if (!ch) ch = info(getChanIndexFromAntPol(ant, pol::kHorizontal)); 
+  if (!ch || ch->ant < 0) return ring::kNotARing; 
+  return ring::ring_t(ch->ring); 
 
 }
 
@@ -294,12 +522,12 @@ pueo::ring::ring_t pueo::GeomTool::getRingAntPolPhiFromSurfChan(Int_t surf, Int_
 						 pol::pol_t &pol,
 						 Int_t &phi) const
 {
-  auto ch = r.fromSurf(surf,chan); 
+  const ChanInfo * ch = info(getChanIndex(surf,chan)); 
   if (!ch) return ring::kNotARing; 
-  ring = ring::fromIdx(ch->ring); 
-  ant = ch->antIdx; 
-  pol = pol::fromChar(ch->pol); 
-  phi = ch->phiSector; 
+  ring = ring::ring_t(ch->ring); 
+  ant = ch->ant; 
+  pol = pol::pol_t(ch->pol); 
+  phi = ch->phi; 
   return ring; 
 }
 
@@ -309,10 +537,15 @@ pueo::ring::ring_t pueo::GeomTool::getRingAntPolPhiFromSurfChan(Int_t surf, Int_
 //Non static thingies
 void pueo::GeomTool::getAntXYZ(Int_t ant, Double_t &x, Double_t &y, Double_t &z,pol::pol_t pol) const
 {
-  auto ch = r.fromAntIdxPol(ant, pol::asChar(pol)); 
-  x = ch->geom.face_center.x; 
-  y = ch->geom.face_center.y; 
-  z = ch->geom.face_center.z; 
+  if (getChanIndexFromAntPol(ant,pol) < 0) 
+  {
+    x = y = z = 0; 
+    return; 
+  }
+  const auto & pos = antPhaseCenter[ant][pol]; 
+  x = pos[0]; 
+  y = pos[1]; 
+  z = pos[2]; 
 }
 
 Double_t pueo::GeomTool::getAntZ(Int_t ant, pol::pol_t pol) const {
@@ -330,19 +563,13 @@ Double_t pueo::GeomTool::getAntR(Int_t ant, pol::pol_t pol) const
 
 Double_t pueo::GeomTool::getAntPhiPosition(Int_t ant, pol::pol_t pol) const{
 
-  auto ch = r.fromAntIdxPol(ant, pol::asChar(pol)); 
-  return ch->geom.phase_phi(); 
+  if (getChanIndexFromAntPol(ant,pol) < 0) return 0; 
+  return antPhasePhi[ant][pol]; 
 }
 
 Double_t pueo::GeomTool::getAntPhiPositionRelToAftFore(Int_t ant, pol::pol_t pol) const {
 
-  Double_t phi= getAntPhiPosition(ant,pol); 
-  phi-=aftForeOffsetAngleVertical;
-  while(phi<0)
-    phi+=TMath::TwoPi();
-  while(phi>TMath::TwoPi())
-    phi-=TMath::TwoPi();
-  return phi; 
+  return wrapTwoPi(getAntPhiPosition(ant,pol) - aftForeOffsetAngleVertical); 
 }
 
 //Double_t pueo::GeomTool::getMeanAntPairPhiRelToAftFore(Int_t firstAnt, Int_t secondAnt, pol::pol_t pol) {
@@ -369,30 +596,27 @@ Double_t pueo::GeomTool::getAntPhiPositionRelToAftFore(Int_t ant, pol::pol_t pol
 //
 
 
+// The tables hold azimuths in the payload frame, so shift the wave direction out of the aft-fore frame instead 
 Int_t pueo::GeomTool::getTopAntNearestPhiWave(Double_t phiWave, pol::pol_t pol) const  {
-  if(phiWave<0) phiWave+=TMath::TwoPi();
-  if(phiWave>TMath::TwoPi()) phiWave-=TMath::TwoPi();
-  Double_t minDiff=TMath::TwoPi();
-  Int_t minAnt=0;;
-  for(Int_t ant=0;ant<16;ant++) {
-    //      std::cout << ant << "\t" << azPhaseCentreFromVerticalHorn[ant][pol] << "\t" << phiPrime << "\t" << TMath::Abs(azPhaseCentreFromVerticalHorn[ant][pol]-phiPrime) << "\n";
-    if(TMath::Abs(getAntPhiPositionRelToAftFore(ant,pol)-phiWave)<minDiff) {
-      minDiff=TMath::Abs(getAntPhiPositionRelToAftFore(ant,pol)-phiWave);
-      minAnt=ant;
-    }
-    
-    if(TMath::Abs((getAntPhiPositionRelToAftFore(ant,pol)-TMath::TwoPi())-phiWave)<minDiff) {
-      minDiff=TMath::Abs((getAntPhiPositionRelToAftFore(ant,pol)-TMath::TwoPi())-phiWave);
-      minAnt=ant;      
-    }
-
-    if(TMath::Abs((getAntPhiPositionRelToAftFore(ant,pol)+TMath::TwoPi())-phiWave)<minDiff) {
-      minDiff=TMath::Abs((getAntPhiPositionRelToAftFore(ant,pol)+TMath::TwoPi())-phiWave);
-      minAnt=ant;      
-    }
+  if (pol < 0 || pol >= k::NUM_POLS) return 0; 
+  const AzTable & t = topPhaseAz[pol]; 
+  int i = t.nearest(wrapTwoPi(phiWave + aftForeOffsetAngleVertical)); 
+  return i < 0 ? 0 : t.ant[i]; 
+}
 
+void pueo::GeomTool::getTopAntNearestPhiWave(const Double_t * phiWave, size_t n, Int_t * ant, pol::pol_t pol) const 
+{
+  if (pol < 0 || pol >= k::NUM_POLS) 
+  {
+    std::fill(ant, ant+n, 0); 
+    return; 
+  }
+  const AzTable & t = topPhaseAz[pol]; 
+  for (size_t j = 0; j < n; j++) 
+  {
+    int i = t.nearest(wrapTwoPi(phiWave[j] + aftForeOffsetAngleVertical)); 
+    ant[j] = i < 0 ? 0 : t.ant[i]; 
   }
-  return minAnt;
 }
 
 Int_t pueo::GeomTool::getUpperAntNearestPhiWave(Double_t phiWave, pol::pol_t pol) const {
@@ -454,37 +678,48 @@ Double_t pueo::GeomTool::getAntFacePhiPositionRelToAftFore(Int_t ant) const {
 }
 
 Int_t pueo::GeomTool::getTopAntFaceNearestPhiWave(Double_t phiWave) const {
-  Double_t phiPrime=phiWave+aftForeOffsetAngleVertical;
-  if(phiPrime>TMath::TwoPi()) 
-    phiPrime-=TMath::TwoPi();
-  Double_t minDiff=TMath::TwoPi();
-  Int_t minAnt=0;;
-  for(Int_t phi=0;phi<k::NUM_PHI;phi++) {
-    int ant = getAntFromPhiRing(phi, ring::kTopRing);
-    if(TMath::Abs(azCenterAntHorns[ant]-phiPrime)<minDiff) {
-      minDiff=TMath::Abs(azCenterAntHorns[ant]-phiPrime);
-      minAnt=ant;
-    }
+  int i = topFaceAz.nearest(wrapTwoPi(phiWave + aftForeOffsetAngleVertical)); 
+  return i < 0 ? 0 : topFaceAz.ant[i]; 
+}
+
+void pueo::GeomTool::getTopAntFaceNearestPhiWave(const Double_t * phiWave, size_t n, Int_t * ant) const 
+{
+  for (size_t j = 0; j < n; j++) 
+  {
+    int i = topFaceAz.nearest(wrapTwoPi(phiWave[j] + aftForeOffsetAngleVertical)); 
+    ant[j] = i < 0 ? 0 : topFaceAz.ant[i]; 
   }
-  return minAnt;
 }
 
+Int_t pueo::GeomTool::getPhiSectorNearestPhiWave(Double_t phiWave) const 
+{
+  int i = topFaceAz.nearest(wrapTwoPi(phiWave + aftForeOffsetAngleVertical)); 
+  return i < 0 ? -1 : getPhiFromAnt(topFaceAz.ant[i]); 
+}
 
+void pueo::GeomTool::getPhiSectorNearestPhiWave(const Double_t * phiWave, size_t n, Int_t * phi) const 
+{
+  for (size_t j = 0; j < n; j++) 
+  {
+    int i = topFaceAz.nearest(wrapTwoPi(phiWave[j] + aftForeOffsetAngleVertical)); 
+    phi[j] = i < 0 ? -1 : getPhiFromAnt(topFaceAz.ant[i]); 
+  }
+}
 
 
 Int_t pueo::GeomTool::getPhiFromAnt(Int_t ant) const
 {
-  auto ch = r.fromAntIdxPol(ant, pueo::pol::asChar(pueo::pol::kHorizontal)); 
-  if (!ch) return -1; 
-  return ch->phiSector; 
+  const ChanInfo * ch = info(getChanIndexFromAntPol(ant, pol::kHorizontal)); 
+  if (!ch || ch->ant < 0) return -1; 
+  return ch->phi; 
 }
 
 
 Int_t pueo::GeomTool::getAntFromPhiRing(Int_t phi, ring::ring_t ring) const
 {
-  auto ch = r.fromPhiRingPol(phi,ring,pueo::pol::asChar(pueo::pol::kHorizontal)); 
-  if (!ch) return -1; 
-  return ch->antIdx; 
+  const ChanInfo * ch = info(getChanIndexFromRingPhiPol(ring, phi, pol::kHorizontal)); 
+  if (!ch || ch->ant < 0) return -1; 
+  return ch->ant; 
 }
 
 
@@ -543,6 +778,55 @@ void pueo::GeomTool::getLatLonAltFromCartesian(Double_t p[3], Double_t &lat, Dou
  
 }
 
+void pueo::GeomTool::getCartesianCoords(const Double_t * lat, const Double_t * lon, const Double_t * alt, size_t n, Double_t * p)
+{
+  const double b2a2 = (1-FLATTENING_FACTOR)*(1-FLATTENING_FACTOR);
+  for (size_t i = 0; i < n; i++)
+  {
+    // same as the single point version: latitude is made positive, x and y are switched
+    double la = fabs(lat[i]) * TMath::DegToRad();
+    double lo = lon[i] * TMath::DegToRad();
+    double sla = sin(la), cla = cos(la);
+    double C2 = 1./sqrt(cla*cla + b2a2*sla*sla);
+    double rxy = (R_EARTH*C2 + alt[i]) * cla;
+    p[3*i+1] = rxy * cos(lo);
+    p[3*i+0] = rxy * sin(lo);
+    p[3*i+2] = (R_EARTH*b2a2*C2 + alt[i]) * sla;
+  }
+}
+
+void pueo::GeomTool::getLatLonAltFromCartesian(const Double_t * p, size_t n, Double_t * lat, Double_t * lon, Double_t * alt)
+{
+  const double e2 = FLATTENING_FACTOR * (2 - FLATTENING_FACTOR);
+  const double e4 = e2*e2;
+  const double inv_a2 = 1./(R_EARTH*R_EARTH);
+  for (size_t i = 0; i < n; i++)
+  {
+    // x and y flipped as in the single point version
+    double x = p[3*i+1];
+    double y = p[3*i+0];
+    double z = p[3*i+2];
+
+    double xy2 = x*x + y*y;
+    double rxy = sqrt(xy2);
+    double P = xy2 * inv_a2;
+    double q = (1-e2) * z*z * inv_a2;
+    double r = (P + q - e4) / 6;
+    double s = e4 * P * q / (4*r*r*r);
+    double t = cbrt(1 + s + sqrt(s*(2+s)));
+    double u = r * (1 + t + 1/t);
+    double v = sqrt(u*u + e4*q);
+    double w = e2 * (u + v - q) / (2*v);
+    double kk = sqrt(u + v + w*w) - w;
+    double D = kk * rxy / (kk + e2);
+    double Dz = sqrt(D*D + z*z);
+
+    lat[i] = -fabs(2 * atan2(z, D + Dz) * TMath::RadToDeg());
+    lon[i] = atan2(y,x) * TMath::RadToDeg();
+    alt[i] = (kk + e2 - 1) / kk * Dz;
+  }
+}
+
 Double_t pueo::GeomTool::getDistanceToCentreOfEarth(Double_t lat)
 {
   Double_t pVec[3];
@@ -0,0 +1,317 @@
+/****************************************************************************************
+*  GroundProjector.cc            Projecting payload-frame directions onto the ground
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/GroundProjector.h"
+#include "pueo/Nav.h"
+#include "parallel.h"
+
+#include "TFile.h"
+#include "TH2.h"
+#include "TDirectory.h"
+#include "TMath.h"
+#include "TMutex.h"
+
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+
+// WGS84, in real Earth-centred Earth-fixed coordinates (not GeomTool's swapped ones)
+static const double WGS84_A = 6378137.;
+static const double WGS84_F = 1./298.257223563;
+static const double WGS84_B = WGS84_A * (1 - WGS84_F);
+static const double WGS84_E2 = WGS84_F * (2 - WGS84_F);
+
+static const int MAX_ITER = 10;
+static const double TOLERANCE = 0.1; // m
+
+
+// Vermeille (2002), as in GeomTool::getLatLonAltFromCartesian's batch version
+static void ecefToGeodetic(const double p[3], double & lat, double & lon, double & alt)
+{
+  const double e4 = WGS84_E2 * WGS84_E2;
+  double xy2 = p[0]*p[0] + p[1]*p[1];
+  double P = xy2 / (WGS84_A * WGS84_A);
+  double q = (1 - WGS84_E2) * p[2]*p[2] / (WGS84_A * WGS84_A);
+  double r = (P + q - e4) / 6;
+  double s = e4 * P * q / (4*r*r*r);
+  double t = cbrt(1 + s + sqrt(s*(2+s)));
+  double u = r * (1 + t + 1/t);
+  double v = sqrt(u*u + e4*q);
+  double w = WGS84_E2 * (u + v - q) / (2*v);
+  double kk = sqrt(u + v + w*w) - w;
+  double D = kk * sqrt(xy2) / (kk + WGS84_E2);
+  double Dz = sqrt(D*D + p[2]*p[2]);
+  lat = 2 * atan2(p[2], D + Dz);
+  lon = atan2(p[1], p[0]);
+  alt = (kk + WGS84_E2 - 1) / kk * Dz;
+}
+
+// distance along d (unit) from p to the ellipsoid raised by h, or -1 if it misses
+static double hitEllipsoid(const double p[3], const double d[3], double h)
+{
+  double ia2 = 1. / ((WGS84_A + h) * (WGS84_A + h));
+  double ib2 = 1. / ((WGS84_B + h) * (WGS84_B + h));
+  double A = (d[0]*d[0] + d[1]*d[1]) * ia2 + d[2]*d[2] * ib2;
+  double B = 2 * ((p[0]*d[0] + p[1]*d[1]) * ia2 + p[2]*d[2] * ib2);
+  double C = (p[0]*p[0] + p[1]*p[1]) * ia2 + p[2]*p[2] * ib2 - 1;
+  double disc = B*B - 4*A*C;
+  if (disc < 0) return -1;
+  double s = (-B - sqrt(disc)) / (2*A);
+  return s >= 0 ? s : -1;
+}
+
+
+/////////////////////////////////////////////////////////////////////////
+// TiledElevation
+
+static TMutex tile_lock;
+static std::atomic<ULong64_t> next_tiled_id(1);
+
+double pueo::TiledElevation::Tile::at(double lat, double lon) const
+{
+  if (!nlat || !nlon) return 0;
+  double x = (lon - lon0) / dlon;
+  double y = (lat - lat0) / dlat;
+  x = std::min(std::max(x, 0.), double(nlon-1));
+  y = std::min(std::max(y, 0.), double(nlat-1));
+  int ix = std::min(int(x), nlon-2 < 0 ? 0 : nlon-2);
+  int iy = std::min(int(y), nlat-2 < 0 ? 0 : nlat-2);
+  int ix1 = std::min(ix+1, nlon-1);
+  int iy1 = std::min(iy+1, nlat-1);
+  double fx = x - ix, fy = y - iy;
+  return (1-fy) * ((1-fx) * h[iy*nlon + ix] + fx * h[iy*nlon + ix1]) +
+           fy   * ((1-fx) * h[iy1*nlon + ix] + fx * h[iy1*nlon + ix1]);
+}
+
+
+pueo::TiledElevation::Loader pueo::TiledElevation::rootFileLoader(const std::string & dir)
+{
+  return [dir](int lat, int lon, Tile & tile)
+  {
+    TString fname = TString::Format("%s/elev_%d_%d.root", dir.c_str(), lat, lon);
+    const TString theRootPwd = gDirectory->GetPath();
+    TFile f(fname, "READ");
+    TH2 * hist = f.IsZombie() ? nullptr : (TH2*) f.Get("elevation");
+    bool ok = hist != nullptr;
+    if (ok)
+    {
+      tile.nlon = hist->GetNbinsX();
+      tile.nlat = hist->GetNbinsY();
+      tile.lon0 = hist->GetXaxis()->GetBinCenter(1);
+      tile.lat0 = hist->GetYaxis()->GetBinCenter(1);
+      tile.dlon = hist->GetXaxis()->GetBinWidth(1);
+      tile.dlat = hist->GetYaxis()->GetBinWidth(1);
+      tile.h.resize(tile.nlon * tile.nlat);
+      for (int j = 0; j < tile.nlat; j++)
+      {
+        for (int i = 0; i < tile.nlon; i++) tile.h[j * tile.nlon + i] = hist->GetBinContent(i+1, j+1);
+      }
+    }
+    gDirectory->cd(theRootPwd);
+    return ok;
+  };
+}
+
+
+pueo::TiledElevation::TiledElevation(const std::string & dir, int deg, size_t n)
+  : TiledElevation(rootFileLoader(dir.size() ? dir : getenv("PUEO_ELEVATION_DIR") ? getenv("PUEO_ELEVATION_DIR") : "."), deg, n)
+{
+}
+
+
+pueo::TiledElevation::TiledElevation(Loader l, int deg, size_t n)
+  : loader(l), tile_deg(deg > 0 ? deg : 1), cache_size(n ? n : 1), id(next_tiled_id++)
+{
+}
+
+
+std::shared_ptr<const pueo::TiledElevation::Tile> pueo::TiledElevation::getTile(int ilat, int ilon) const
+{
+  Long64_t key = (Long64_t(ilat) << 32) | UInt_t(ilon);
+
+  // hot path: the same tile as last time on this thread
+  thread_local ULong64_t last_id = 0;
+  thread_local Long64_t last_key = 0;
+  thread_local std::shared_ptr<const Tile> last;
+  if (last && last_id == id && last_key == key) return last;
+
+  TLockGuard l(&tile_lock);
+
+  std::shared_ptr<const Tile> found;
+  for (auto it = cache.begin(); it != cache.end(); it++)
+  {
+    if (it->first == key)
+    {
+      found = it->second;
+      cache.splice(cache.begin(), cache, it);
+      break;
+    }
+  }
+
+  if (!found)
+  {
+    std::shared_ptr<Tile> tile(new Tile);
+    if (!loader || !loader(ilat * tile_deg, ilon * tile_deg, *tile)) *tile = Tile(); // remember that it's missing
+    else nloaded++;
+    cache.emplace_front(key, tile);
+    while (cache.size() > cache_size) cache.pop_back();
+    found = tile;
+  }
+
+  last_id = id;
+  last_key = key;
+  last = found;
+  return found;
+}
+
+
+double pueo::TiledElevation::getElevation(double lat, double lon) const
+{
+  if (lon >= 180) lon -= 360;
+  if (lon < -180) lon += 360;
+  int ilat = int(floor(lat / tile_deg));
+  int ilon = int(floor(lon / tile_deg));
+  return getTile(ilat, ilon)->at(lat, lon);
+}
+
+
+/////////////////////////////////////////////////////////////////////////
+// GroundProjector
+
+pueo::GroundProjector::GroundProjector(std::shared_ptr<const ElevationModel> m, const GeomTool * geom)
+  : model(m ? m : std::make_shared<ConstantElevation>(0)), frames(geom)
+{
+}
+
+
+void pueo::GroundProjector::setAttitudes(const nav::Attitude * att, size_t n)
+{
+  frames.set(att, n);
+}
+
+
+void pueo::GroundProjector::setAttitudes(const std::vector<nav::Attitude> & att)
+{
+  frames.set(att);
+}
+
+
+bool pueo::GroundProjector::intersect(const nav::AttitudeFrame & f, double phi, double theta, GroundPoint & out) const
+{
+  out = GroundPoint();
+
+  double v[3], d[3];
+  nav::anglesToVectors(1, &phi, &theta, v);
+  f.transform(nav::kPayload, nav::kEarth, 1, v, d);
+
+  // Intersect with the ellipsoid raised by h, then move it to the surface height found there.
+  // Raising the ellipsoid isn't quite the same as raising the geodetic height, so iterate.
+  double h = 0;
+  for (int iter = 0; iter < MAX_ITER; iter++)
+  {
+    double s = hitEllipsoid(f.ecef.data(), d, h);
+    if (s < 0) return false;
+
+    double x[3] = { f.ecef[0] + s*d[0], f.ecef[1] + s*d[1], f.ecef[2] + s*d[2] };
+    double lat, lon, alt;
+    ecefToGeodetic(x, lat, lon, alt);
+    lat *= TMath::RadToDeg();
+    lon *= TMath::RadToDeg();
+    double surface = model->getElevation(lat, lon);
+
+    if (fabs(alt - surface) < TOLERANCE)
+    {
+      out.lat = lat;
+      out.lon = lon;
+      out.alt = alt;
+      out.distance = s;
+      out.ok = true;
+      return true;
+    }
+    h += surface - alt;
+  }
+  return false;
+}
+
+
+size_t pueo::GroundProjector::project(size_t iatt, size_t n, const double * phi, const double * theta, GroundPoint * out, int nthreads) const
+{
+  if (iatt >= frames.size())
+  {
+    for (size_t i = 0; i < n; i++) out[i] = GroundPoint();
+    return 0;
+  }
+
+  std::atomic<size_t> nok(0);
+  parallel::forEach(n, nthreads, [&](size_t i) { if (intersect(frames.get(iatt), phi[i], theta[i], out[i])) nok++; });
+  return nok;
+}
+
+
+size_t pueo::GroundProjector::project(size_t n, const size_t * iatt, const double * phi, const double * theta, GroundPoint * out, int nthreads) const
+{
+  std::atomic<size_t> nok(0);
+  parallel::forEach(n, nthreads, [&](size_t i)
+  {
+    if (iatt[i] >= frames.size()) out[i] = GroundPoint();
+    else if (intersect(frames.get(iatt[i]), phi[i], theta[i], out[i])) nok++;
+  });
+  return nok;
+}
+
+
+size_t pueo::GroundProjector::projectAt(double t, size_t n, const double * phi, const double * theta, GroundPoint * out, int nthreads) const
+{
+  nav::AttitudeFrame f;
+  if (!frames.at(t, f))
+  {
+    for (size_t i = 0; i < n; i++) out[i] = GroundPoint();
+    return 0;
+  }
+
+  std::atomic<size_t> nok(0);
+  parallel::forEach(n, nthreads, [&](size_t i) { if (intersect(f, phi[i], theta[i], out[i])) nok++; });
+  return nok;
+}
+
+
+size_t pueo::GroundProjector::projectAt(size_t n, const double * t, const double * phi, const double * theta, GroundPoint * out, int nthreads) const
+{
+  std::atomic<size_t> nok(0);
+  parallel::forEach(n, nthreads, [&](size_t i)
+  {
+    nav::AttitudeFrame f;
+    if (!frames.at(t[i], f)) out[i] = GroundPoint();
+    else if (intersect(f, phi[i], theta[i], out[i])) nok++;
+  });
+  return nok;
+}
+
+
+bool pueo::GroundProjector::project(const nav::Attitude & att, double phi, double theta, GroundPoint & out) const
+{
+  return intersect(frames.makeFrame(att), phi, theta, out);
+}
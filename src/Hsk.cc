@@ -0,0 +1,166 @@
+/****************************************************************************************
+*  Hsk.cc             PUEO Hsk sensors
+*
+*  Compact housekeeping readings and the sensor table that goes with them
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/Hsk.h"
+
+#include "TDirectory.h"
+#include "TTree.h"
+#include "TObject.h"
+
+#include <string.h>
+
+
+pueo::hsk::Sensor pueo::hsk::Reading::toSensor(const SensorInfo & info) const
+{
+  Sensor s;
+  s.sensor_id = sensor_id;
+  s.time_ms = time_ms;
+  s.time_secs = time_secs;
+  s.subsys = info.subsys;
+  s.sens_name = info.name;
+  s.typetag = info.typetag;
+  s.kind_unit = info.kind_unit;
+
+  // the old Sensor has every interpretation of the same 32 bits
+  if (info.typetag == 'I' || info.typetag == 'i')
+  {
+    s.ival = Int_t(value);
+    memcpy(&s.uval, &s.ival, sizeof(s.uval));
+    memcpy(&s.fval, &s.ival, sizeof(s.fval));
+  }
+  else if (info.typetag == 'U' || info.typetag == 'u')
+  {
+    s.uval = UInt_t(value);
+    memcpy(&s.ival, &s.uval, sizeof(s.ival));
+    memcpy(&s.fval, &s.uval, sizeof(s.fval));
+  }
+  else
+  {
+    s.fval = Float_t(value);
+    memcpy(&s.ival, &s.fval, sizeof(s.ival));
+    memcpy(&s.uval, &s.fval, sizeof(s.uval));
+  }
+  return s;
+}
+
+
+void pueo::hsk::SensorTable::add(const SensorInfo & info)
+{
+  if (info.sensor_id >= sensors.size()) sensors.resize(info.sensor_id + 1);
+  if (sensors[info.sensor_id].name.empty()) nknown++;
+  sensors[info.sensor_id] = info;
+}
+
+
+const pueo::hsk::SensorInfo * pueo::hsk::SensorTable::get(UShort_t sensor_id) const
+{
+  if (sensor_id >= sensors.size() || sensors[sensor_id].name.empty()) return nullptr;
+  return &sensors[sensor_id];
+}
+
+
+const pueo::hsk::SensorInfo * pueo::hsk::SensorTable::find(const char * name) const
+{
+  const char * slash = strchr(name, '/');
+  std::string subsys = slash ? std::string(name, slash - name) : "";
+  const char * sname = slash ? slash + 1 : name;
+
+  const SensorInfo * found = nullptr;
+  for (const SensorInfo & info : sensors)
+  {
+    if (info.name.empty() || info.name != sname) continue;
+    if (slash && info.subsys != subsys) continue;
+    if (found) return nullptr; // ambiguous
+    found = &info;
+  }
+  return found;
+}
+
+
+pueo::hsk::Sensor pueo::hsk::SensorTable::sensor(const Reading & r) const
+{
+  const SensorInfo * info = get(r.sensor_id);
+  return r.toSensor(info ? *info : SensorInfo());
+}
+
+
+bool pueo::hsk::SensorTable::read(TDirectory * d)
+{
+  TTree * t = d->Get<TTree>(tree_name);
+  if (!t) return false;
+
+  SensorInfo * info = nullptr;
+  t->SetBranchAddress("sensor", &info);
+  for (Long64_t i = 0; i < t->GetEntries(); i++)
+  {
+    t->GetEntry(i);
+    add(*info);
+  }
+  delete t;
+  delete info;
+  return true;
+}
+
+
+void pueo::hsk::SensorTable::write(TDirectory * d) const
+{
+  d->cd();
+  TTree * t = new TTree(tree_name, "Housekeeping sensors");
+  SensorInfo info;
+  SensorInfo * pinfo = &info;
+  t->Branch("sensor", &pinfo);
+  for (const SensorInfo & s : sensors)
+  {
+    if (s.name.empty()) continue;
+    info = s;
+    t->Fill();
+  }
+  t->Write("", TObject::kOverwrite);
+  delete t;
+}
+
+
+#ifdef HAVE_PUEORAWDATA
+pueo::hsk::SensorTable pueo::hsk::SensorTable::fromRawData()
+{
+  SensorTable table;
+  for (int id = 0; id < PUEO_MAX_SENSORS; id++)
+  {
+    const char * name = pueo_sensor_id_get_name(id);
+    if (!name || !*name) continue;
+
+    SensorInfo info;
+    info.sensor_id = id;
+    const char * subsys = pueo_sensor_id_get_subsystem(id);
+    info.subsys = subsys ? subsys : "";
+    info.name = name;
+    info.typetag = pueo_sensor_id_get_type_tag(id);
+    info.kind_unit = pueo_sensor_id_get_kind(id);
+    table.add(info);
+  }
+  return table;
+}
+#endif
@@ -0,0 +1,336 @@
+/****************************************************************************************
+*  HskSeries.cc              Per-sensor queries on housekeeping data
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/HskSeries.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TTreeIndex.h"
+#include "TDirectory.h"
+
+#include <algorithm>
+#include <numeric>
+#include <string.h>
+#include <stdio.h>
+
+
+pueo::hsk::SeriesReader::SeriesReader(const char * fname)
+{
+  const TString theRootPwd = gDirectory->GetPath();
+  file.reset(new TFile(fname, "READ"));
+  if (file->IsOpen())
+  {
+    tree = file->Get<TTree>("hskseriesTree");
+    if (tree) sensors.read(file.get());
+    else tree = file->Get<TTree>("hskTree");
+  }
+  gDirectory->cd(theRootPwd);
+
+  if (!tree)
+  {
+    fprintf(stderr, "No hskseriesTree or hskTree in %s\n", fname);
+    return;
+  }
+
+  compact = tree->GetBranch("hskseries") != nullptr;
+  TTreeIndex * idx = dynamic_cast<TTreeIndex*>(tree->GetTreeIndex());
+  indexed = compact && idx && !strcmp(idx->GetMajorName(), "sensor_id");
+}
+
+
+pueo::hsk::SeriesReader::SeriesReader(TTree * t, const SensorTable * table)
+  : tree(t)
+{
+  if (!tree) return;
+  compact = tree->GetBranch("hskseries") != nullptr;
+  TTreeIndex * idx = dynamic_cast<TTreeIndex*>(tree->GetTreeIndex());
+  indexed = compact && idx && !strcmp(idx->GetMajorName(), "sensor_id");
+
+  if (table) sensors = *table;
+  else if (compact && tree->GetDirectory()) sensors.read(tree->GetDirectory());
+}
+
+
+pueo::hsk::SeriesReader::~SeriesReader()
+{
+}
+
+
+const pueo::hsk::SensorTable & pueo::hsk::SeriesReader::getSensors()
+{
+  // old-style trees have the names in every entry
+  if (!compact && !scanned) scan();
+  return sensors;
+}
+
+
+int pueo::hsk::SeriesReader::resolve(const char * name)
+{
+  const SensorInfo * info = getSensors().find(name);
+  return info ? info->sensor_id : -1;
+}
+
+
+const pueo::hsk::SeriesReader::Series * pueo::hsk::SeriesReader::get(UShort_t sensor_id)
+{
+  if (!tree) return nullptr;
+
+  auto it = cache.find(sensor_id);
+  if (it != cache.end()) return &it->second;
+
+  if (!indexed)
+  {
+    if (scanned) return nullptr;
+    scan();
+    it = cache.find(sensor_id);
+    return it == cache.end() ? nullptr : &it->second;
+  }
+
+  Series & s = cache[sensor_id];
+  load(sensor_id, s);
+  return &s;
+}
+
+
+// one sensor's entries, from the converter's index, which has them sorted by (sensor_id, time in ms)
+void pueo::hsk::SeriesReader::load(UShort_t sensor_id, Series & s)
+{
+  TTreeIndex * idx = (TTreeIndex*) tree->GetTreeIndex();
+  const Long64_t * major = idx->GetIndexValues();
+  const Long64_t * minor = idx->GetIndexValuesMinor();
+  const Long64_t * entry = idx->GetIndex();
+  Long64_t n = idx->GetN();
+
+  Long64_t lo = std::lower_bound(major, major + n, (Long64_t) sensor_id) - major;
+  Long64_t hi = std::upper_bound(major + lo, major + n, (Long64_t) sensor_id) - major;
+
+  Reading * r = nullptr;
+  tree->SetBranchAddress("hskseries", &r);
+  TBranch * value = tree->GetBranch("value");
+
+  s.t.reserve(hi - lo);
+  s.v.reserve(hi - lo);
+  for (Long64_t i = lo; i < hi; i++)
+  {
+    value->GetEntry(entry[i]);
+    s.t.push_back(minor[i] * 1e-3);
+    s.v.push_back(r->value);
+  }
+  tree->ResetBranchAddresses();
+  delete r;
+  finish(s);
+}
+
+
+// everything, in one pass
+void pueo::hsk::SeriesReader::scan()
+{
+  scanned = true;
+  cache.clear();
+
+  if (compact)
+  {
+    Reading * r = nullptr;
+    tree->SetBranchAddress("hskseries", &r);
+    for (Long64_t i = 0; i < tree->GetEntries(); i++)
+    {
+      tree->GetEntry(i);
+      Series & s = cache[r->sensor_id];
+      s.t.push_back(r->getTime());
+      s.v.push_back(r->value);
+    }
+    tree->ResetBranchAddresses();
+    delete r;
+  }
+  else
+  {
+    Sensor * sn = nullptr;
+    tree->SetBranchAddress("hsk", &sn);
+    for (Long64_t i = 0; i < tree->GetEntries(); i++)
+    {
+      tree->GetEntry(i);
+      Series & s = cache[sn->sensor_id];
+      s.t.push_back(sn->time_secs + 1e-3 * sn->time_ms);
+      s.v.push_back(Reading::decode(sn->typetag, sn->fval, sn->ival, sn->uval));
+
+      if (!sensors.get(sn->sensor_id))
+      {
+        SensorInfo info;
+        info.sensor_id = sn->sensor_id;
+        info.subsys = sn->subsys;
+        info.name = sn->sens_name;
+        info.typetag = sn->typetag;
+        info.kind_unit = sn->kind_unit;
+        sensors.add(info);
+      }
+    }
+    tree->ResetBranchAddresses();
+    delete sn;
+  }
+
+  for (auto & c : cache) finish(c.second);
+}
+
+
+// sort by time (if it isn't already) and make the block envelopes
+void pueo::hsk::SeriesReader::finish(Series & s)
+{
+  if (!std::is_sorted(s.t.begin(), s.t.end()))
+  {
+    std::vector<size_t> order(s.t.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return s.t[a] < s.t[b]; });
+    std::vector<Double_t> t(s.t.size()), v(s.v.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+      t[i] = s.t[order[i]];
+      v[i] = s.v[order[i]];
+    }
+    s.t.swap(t);
+    s.v.swap(v);
+  }
+
+  size_t nblocks = s.v.size() / block_size;
+  s.block_min.resize(nblocks);
+  s.block_max.resize(nblocks);
+  for (size_t b = 0; b < nblocks; b++)
+  {
+    auto mm = std::minmax_element(s.v.begin() + b * block_size, s.v.begin() + (b+1) * block_size);
+    s.block_min[b] = *mm.first;
+    s.block_max[b] = *mm.second;
+  }
+}
+
+
+void pueo::hsk::SeriesReader::loadAll()
+{
+  if (tree && !scanned) scan();
+}
+
+
+size_t pueo::hsk::SeriesReader::size(UShort_t sensor_id)
+{
+  const Series * s = get(sensor_id);
+  return s ? s->t.size() : 0;
+}
+
+
+size_t pueo::hsk::SeriesReader::series(UShort_t sensor_id, double t0, double t1, std::vector<Point> & out)
+{
+  out.clear();
+  const Series * s = get(sensor_id);
+  if (!s) return 0;
+
+  size_t lo = std::lower_bound(s->t.begin(), s->t.end(), t0) - s->t.begin();
+  size_t hi = std::upper_bound(s->t.begin(), s->t.end(), t1) - s->t.begin();
+  for (size_t i = lo; i < hi; i++)
+  {
+    Point p;
+    p.t = s->t[i];
+    p.value = s->v[i];
+    out.push_back(p);
+  }
+  return out.size();
+}
+
+
+bool pueo::hsk::SeriesReader::valueAt(UShort_t sensor_id, double t, Point & out)
+{
+  const Series * s = get(sensor_id);
+  if (!s) return false;
+
+  size_t hi = std::upper_bound(s->t.begin(), s->t.end(), t) - s->t.begin();
+  if (!hi) return false;
+  out.t = s->t[hi-1];
+  out.value = s->v[hi-1];
+  return true;
+}
+
+
+size_t pueo::hsk::SeriesReader::envelope(UShort_t sensor_id, double t0, double t1, int nbins, std::vector<EnvelopeBin> & out)
+{
+  out.assign(nbins > 0 ? nbins : 0, EnvelopeBin());
+  const Series * s = get(sensor_id);
+  if (!s || nbins <= 0) return 0;
+
+  size_t total = 0;
+  double dt = (t1 - t0) / nbins;
+  size_t lo = std::lower_bound(s->t.begin(), s->t.end(), t0) - s->t.begin();
+  for (int b = 0; b < nbins; b++)
+  {
+    EnvelopeBin & bin = out[b];
+    bin.t0 = t0 + b * dt;
+    bin.t1 = b == nbins - 1 ? t1 : t0 + (b+1) * dt;
+    size_t hi = std::lower_bound(s->t.begin() + lo, s->t.end(), bin.t1) - s->t.begin();
+
+    bin.n = hi - lo;
+    total += bin.n;
+    if (lo < hi)
+    {
+      bin.min = bin.max = s->v[lo];
+      size_t i = lo;
+      // the ragged start, whole blocks, then the ragged end
+      for (; i < hi && i % block_size; i++) { bin.min = std::min(bin.min, s->v[i]); bin.max = std::max(bin.max, s->v[i]); }
+      for (; i + block_size <= hi; i += block_size)
+      {
+        bin.min = std::min(bin.min, s->block_min[i / block_size]);
+        bin.max = std::max(bin.max, s->block_max[i / block_size]);
+      }
+      for (; i < hi; i++) { bin.min = std::min(bin.min, s->v[i]); bin.max = std::max(bin.max, s->v[i]); }
+    }
+    lo = hi;
+  }
+  return total;
+}
+
+
+size_t pueo::hsk::SeriesReader::series(const char * name, double t0, double t1, std::vector<Point> & out)
+{
+  int id = resolve(name);
+  if (id < 0)
+  {
+    out.clear();
+    return 0;
+  }
+  return series(id, t0, t1, out);
+}
+
+
+bool pueo::hsk::SeriesReader::valueAt(const char * name, double t, Point & out)
+{
+  int id = resolve(name);
+  return id >= 0 && valueAt(id, t, out);
+}
+
+
+size_t pueo::hsk::SeriesReader::envelope(const char * name, double t0, double t1, int nbins, std::vector<EnvelopeBin> & out)
+{
+  int id = resolve(name);
+  if (id < 0)
+  {
+    out.assign(nbins > 0 ? nbins : 0, EnvelopeBin());
+    return 0;
+  }
+  return envelope(id, t0, t1, nbins, out);
+}
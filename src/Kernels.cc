@@ -0,0 +1,101 @@
+/****************************************************************************************
+*  Kernels.cc            Internal waveform kernels
+*
+*  The loops here are deliberately simple so that the compiler vectorizes them. With
+*  GCC or Clang on x86_64 each one is built for AVX-512, AVX2 and baseline and the
+*  dynamic loader picks the best one for the CPU we run on (via target_clones).
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "kernels.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(__APPLE__)
+#define PUEO_KERNEL __attribute__((target_clones("avx512f","avx2","default")))
+#else
+#define PUEO_KERNEL
+#endif
+
+
+PUEO_KERNEL
+void pueo::kernels::convert(const int16_t * __restrict__ in, double * __restrict__ out, size_t n, double scale, double offset)
+{
+  for (size_t i = 0; i < n; i++) out[i] = in[i] * scale + offset;
+}
+
+PUEO_KERNEL
+void pueo::kernels::convert(const int16_t * __restrict__ in, float * __restrict__ out, size_t n, float scale, float offset)
+{
+  for (size_t i = 0; i < n; i++) out[i] = in[i] * scale + offset;
+}
+
+PUEO_KERNEL
+void pueo::kernels::lookup(const int16_t * __restrict__ in, double * __restrict__ out, size_t n, const float * __restrict__ lut, int lut_offset, int lut_size)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    int idx = in[i] + lut_offset;
+    idx = idx < 0 ? 0 : idx >= lut_size ? lut_size - 1 : idx;
+    out[i] = lut[idx];
+  }
+}
+
+PUEO_KERNEL
+void pueo::kernels::lookup(const int16_t * __restrict__ in, float * __restrict__ out, size_t n, const float * __restrict__ lut, int lut_offset, int lut_size)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    int idx = in[i] + lut_offset;
+    idx = idx < 0 ? 0 : idx >= lut_size ? lut_size - 1 : idx;
+    out[i] = lut[idx];
+  }
+}
+
+PUEO_KERNEL
+float pueo::kernels::beamPower(const int16_t * const * in, const int * delays, size_t nchan, size_t n, size_t window, float * __restrict__ work)
+{
+  float * __restrict__ sum = work;
+  float * __restrict__ pw = work + n;
+
+  for (size_t i = 0; i < n; i++) sum[i] = 0;
+  for (size_t c = 0; c < nchan; c++)
+  {
+    if (!in[c] || delays[c] < 0 || size_t(delays[c]) >= n) continue;
+    const size_t d = delays[c];
+    const int16_t * __restrict__ x = in[c];
+    for (size_t i = d; i < n; i++) sum[i] += x[i-d];
+  }
+
+  for (size_t i = 0; i < n; i++) pw[i] = sum[i] * sum[i];
+
+  // windowed sum, reusing sum
+  if (window < 1) window = 1;
+  if (window > n) return 0;
+  const size_t nout = n - window + 1;
+  for (size_t i = 0; i < nout; i++) sum[i] = 0;
+  for (size_t w = 0; w < window; w++)
+  {
+    for (size_t i = 0; i < nout; i++) sum[i] += pw[i+w];
+  }
+
+  float best = 0;
+  for (size_t i = 0; i < nout; i++) best = sum[i] > best ? sum[i] : best;
+  return best;
+}
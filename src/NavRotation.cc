@@ -0,0 +1,269 @@
+/****************************************************************************************
+*  NavRotation.cc            Cached payload <-> Earth rotations from attitude samples
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/NavRotation.h"
+#include "pueo/Nav.h"
+#include "pueo/GeomTool.h"
+
+#include "TMath.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+
+// WGS84
+static const double WGS84_A = 6378137.;
+static const double WGS84_E2 = (1./298.257223563) * (2 - 1./298.257223563);
+
+
+pueo::nav::Quaternion pueo::nav::Quaternion::fromAxisAngle(double ax, double ay, double az, double angle)
+{
+  double norm = sqrt(ax*ax + ay*ay + az*az);
+  double s = norm > 0 ? sin(angle/2) / norm : 0;
+  Quaternion q;
+  q.w = cos(angle/2);
+  q.x = ax * s;
+  q.y = ay * s;
+  q.z = az * s;
+  return q;
+}
+
+
+pueo::nav::Quaternion pueo::nav::Quaternion::operator*(const Quaternion & o) const
+{
+  Quaternion q;
+  q.w = w*o.w - x*o.x - y*o.y - z*o.z;
+  q.x = w*o.x + x*o.w + y*o.z - z*o.y;
+  q.y = w*o.y - x*o.z + y*o.w + z*o.x;
+  q.z = w*o.z + x*o.y - y*o.x + z*o.w;
+  return q;
+}
+
+
+pueo::nav::Quaternion pueo::nav::Quaternion::slerp(const Quaternion & a, const Quaternion & b_in, double f)
+{
+  Quaternion b = b_in;
+  double dot = a.w*b.w + a.x*b.x + a.y*b.y + a.z*b.z;
+
+  // q and -q are the same rotation, take the short way around
+  if (dot < 0)
+  {
+    b.w = -b.w; b.x = -b.x; b.y = -b.y; b.z = -b.z;
+    dot = -dot;
+  }
+
+  double fa, fb;
+  if (dot > 0.9995)
+  {
+    // close enough that a normalized lerp is as good and doesn't divide by ~0
+    fa = 1 - f;
+    fb = f;
+  }
+  else
+  {
+    double omega = acos(dot);
+    double so = sin(omega);
+    fa = sin((1-f) * omega) / so;
+    fb = sin(f * omega) / so;
+  }
+
+  Quaternion q;
+  q.w = fa * a.w + fb * b.w;
+  q.x = fa * a.x + fb * b.x;
+  q.y = fa * a.y + fb * b.y;
+  q.z = fa * a.z + fb * b.z;
+  double norm = sqrt(q.w*q.w + q.x*q.x + q.y*q.y + q.z*q.z);
+  q.w /= norm; q.x /= norm; q.y /= norm; q.z /= norm;
+  return q;
+}
+
+
+void pueo::nav::Quaternion::toMatrix(double m[9]) const
+{
+  m[0] = 1 - 2*(y*y + z*z); m[1] = 2*(x*y - w*z);     m[2] = 2*(x*z + w*y);
+  m[3] = 2*(x*y + w*z);     m[4] = 1 - 2*(x*x + z*z); m[5] = 2*(y*z - w*x);
+  m[6] = 2*(x*z - w*y);     m[7] = 2*(y*z + w*x);     m[8] = 1 - 2*(x*x + y*y);
+}
+
+
+void pueo::nav::AttitudeFrame::updateMatrices()
+{
+  toLocal.toMatrix(localMatrix.data());
+  toEarth.toMatrix(earthMatrix.data());
+}
+
+
+void pueo::nav::AttitudeFrame::transform(frame_t from, frame_t to, size_t n, const double * in, double * out) const
+{
+  // M = R_to * R_from^T, where R_x takes payload to x
+  static const double identity[9] = { 1,0,0, 0,1,0, 0,0,1 };
+  const double * Rfrom = from == kLocal ? localMatrix.data() : from == kEarth ? earthMatrix.data() : identity;
+  const double * Rto = to == kLocal ? localMatrix.data() : to == kEarth ? earthMatrix.data() : identity;
+
+  double M[9];
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      M[3*i+j] = Rto[3*i]*Rfrom[3*j] + Rto[3*i+1]*Rfrom[3*j+1] + Rto[3*i+2]*Rfrom[3*j+2];
+
+  for (size_t k = 0; k < n; k++)
+  {
+    double x = in[3*k], y = in[3*k+1], z = in[3*k+2];
+    out[3*k]   = M[0]*x + M[1]*y + M[2]*z;
+    out[3*k+1] = M[3]*x + M[4]*y + M[5]*z;
+    out[3*k+2] = M[6]*x + M[7]*y + M[8]*z;
+  }
+}
+
+
+void pueo::nav::anglesToVectors(size_t n, const double * phi, const double * theta, double * v)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    double ph = phi[i] * TMath::DegToRad();
+    double th = theta[i] * TMath::DegToRad();
+    v[3*i]   = cos(th) * cos(ph);
+    v[3*i+1] = cos(th) * sin(ph);
+    v[3*i+2] = sin(th);
+  }
+}
+
+
+void pueo::nav::vectorsToAngles(size_t n, const double * v, double * phi, double * theta)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    double x = v[3*i], y = v[3*i+1], z = v[3*i+2];
+    double ph = atan2(y,x) * TMath::RadToDeg();
+    phi[i] = ph < 0 ? ph + 360 : ph;
+    theta[i] = atan2(z, sqrt(x*x + y*y)) * TMath::RadToDeg();
+  }
+}
+
+
+pueo::nav::RotationCache::RotationCache(const GeomTool * geom)
+{
+  if (!geom) geom = &GeomTool::Instance();
+  aft_fore_offset = geom->aftForeOffsetAngleVertical;
+}
+
+
+double pueo::nav::RotationCache::getTime(const Attitude & att)
+{
+  return att.realTime + 1e-9 * att.realTimeNsecs;
+}
+
+
+pueo::nav::AttitudeFrame pueo::nav::RotationCache::makeFrame(const Attitude & att) const
+{
+  AttitudeFrame f;
+  f.time = getTime(att);
+  f.latitude = att.latitude;
+  f.longitude = att.longitude;
+  f.altitude = att.altitude;
+
+  double lat = att.latitude * TMath::DegToRad();
+  double lon = att.longitude * TMath::DegToRad();
+  double sla = sin(lat), cla = cos(lat);
+  double N = WGS84_A / sqrt(1 - WGS84_E2 * sla * sla);
+  f.ecef[0] = (N + att.altitude) * cla * cos(lon);
+  f.ecef[1] = (N + att.altitude) * cla * sin(lon);
+  f.ecef[2] = (N * (1 - WGS84_E2) + att.altitude) * sla;
+
+  // payload -> level: roll about x, then pitch about y (positive pitch raises +x)
+  Quaternion level = Quaternion::fromAxisAngle(0,1,0, -att.pitch * TMath::DegToRad()) *
+                     Quaternion::fromAxisAngle(1,0,0, att.roll * TMath::DegToRad());
+
+  // level -> east/north/up: +x points at bearing beta (clockwise from north)
+  double beta = att.heading * TMath::DegToRad() + aft_fore_offset;
+  f.toLocal = Quaternion::fromAxisAngle(0,0,1, TMath::PiOver2() - beta) * level;
+
+  // east/north/up -> Earth-fixed
+  Quaternion enu = Quaternion::fromAxisAngle(0,0,1, TMath::PiOver2() + lon) *
+                   Quaternion::fromAxisAngle(1,0,0, TMath::PiOver2() - lat);
+  f.toEarth = enu * f.toLocal;
+
+  f.updateMatrices();
+  return f;
+}
+
+
+void pueo::nav::RotationCache::set(const Attitude * att, size_t n)
+{
+  frames.resize(n);
+  for (size_t i = 0; i < n; i++) frames[i] = makeFrame(att[i]);
+
+  order.resize(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return frames[a].time < frames[b].time; });
+  times.resize(n);
+  for (size_t i = 0; i < n; i++) times[i] = frames[order[i]].time;
+}
+
+
+void pueo::nav::RotationCache::set(const std::vector<Attitude> & att)
+{
+  set(att.data(), att.size());
+}
+
+
+bool pueo::nav::RotationCache::at(double t, AttitudeFrame & f) const
+{
+  if (times.empty()) return false;
+
+  size_t hi = std::upper_bound(times.begin(), times.end(), t) - times.begin();
+  if (hi == 0 || hi == times.size())
+  {
+    f = frames[order[hi == 0 ? 0 : hi-1]];
+    return true;
+  }
+
+  const AttitudeFrame & a = frames[order[hi-1]];
+  const AttitudeFrame & b = frames[order[hi]];
+  double dt = b.time - a.time;
+  double w = dt > 0 ? (t - a.time) / dt : 0;
+
+  f.time = t;
+  f.latitude = a.latitude + w * (b.latitude - a.latitude);
+  double dlon = b.longitude - a.longitude;
+  if (dlon > 180) dlon -= 360;
+  if (dlon < -180) dlon += 360;
+  f.longitude = a.longitude + w * dlon;
+  if (f.longitude >= 180) f.longitude -= 360;
+  if (f.longitude < -180) f.longitude += 360;
+  f.altitude = a.altitude + w * (b.altitude - a.altitude);
+  for (int i = 0; i < 3; i++) f.ecef[i] = a.ecef[i] + w * (b.ecef[i] - a.ecef[i]);
+  f.toLocal = Quaternion::slerp(a.toLocal, b.toLocal, w);
+  f.toEarth = Quaternion::slerp(a.toEarth, b.toEarth, w);
+  f.updateMatrices();
+  return true;
+}
+
+
+size_t pueo::nav::RotationCache::at(const double * t, size_t n, AttitudeFrame * out) const
+{
+  if (times.empty()) return 0;
+  for (size_t i = 0; i < n; i++) at(t[i], out[i]);
+  return n;
+}
@@ -0,0 +1,234 @@
+/****************************************************************************************
+*  SkyMap.cc            Interferometric sky maps
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/SkyMap.h"
+#include "pueo/CorrelationCache.h"
+#include "pueo/GeomTool.h"
+#include "pueo/UsefulEvent.h"
+#include "parallel.h"
+
+#include "TH2.h"
+#include "TMath.h"
+
+#include <cmath>
+#include <algorithm>
+
+
+static const double C_M_PER_NS = 0.299792458;
+
+
+void pueo::SkyMap::reset(const SkyMapConfig & cfg)
+{
+  nphi = cfg.nphi;
+  ntheta = cfg.ntheta;
+  phi_min = cfg.phi_min;
+  phi_max = cfg.phi_max;
+  theta_min = cfg.theta_min;
+  theta_max = cfg.theta_max;
+  values.assign(size_t(nphi) * ntheta, 0.f);
+}
+
+
+void pueo::SkyMap::findPeak(double & th, double & ph, double & value) const
+{
+  size_t imax = std::max_element(values.begin(), values.end()) - values.begin();
+  th = theta(imax / nphi);
+  ph = phi(imax % nphi);
+  value = values[imax];
+}
+
+
+TH2D * pueo::SkyMap::makeHist(const char * name) const
+{
+  TH2D * h = new TH2D(name, Form("Event %lu %cPol;#phi [deg];#theta [deg]", eventNumber, pol::asChar(pol)),
+                      nphi, phi_min, phi_max, ntheta, theta_min, theta_max);
+  h->SetDirectory(0);
+  for (int itheta = 0; itheta < ntheta; itheta++)
+  {
+    for (int iphi = 0; iphi < nphi; iphi++)
+    {
+      h->SetBinContent(iphi+1, itheta+1, at(itheta,iphi));
+    }
+  }
+  h->SetStats(0);
+  return h;
+}
+
+
+pueo::SkyMapper::SkyMapper(pol::pol_t p, const SkyMapConfig & c)
+  : pol(p), cfg(c)
+{
+  init(GeomTool::Instance());
+}
+
+
+pueo::SkyMapper::SkyMapper(pol::pol_t p, const SkyMapConfig & c, const GeomTool & geom)
+  : pol(p), cfg(c)
+{
+  init(geom);
+}
+
+
+void pueo::SkyMapper::init(const GeomTool & geom)
+{
+  std::vector<double> x,y,z,az;
+
+  int nants = cfg.include_lf ? k::NUM_ANTS : k::NUM_HORNS;
+  for (int ant = 0; ant < nants; ant++)
+  {
+    int chan = geom.getChanIndexFromAntPol(ant, pol);
+    if (chan < 0 || chan >= k::NUM_RF_CHANNELS) continue;
+    double ax,ay,az_;
+    geom.getAntXYZ(ant, ax, ay, az_, pol);
+    chans.push_back(chan);
+    x.push_back(ax);
+    y.push_back(ay);
+    z.push_back(az_);
+    az.push_back(geom.getAntPhiPosition(ant, pol));
+  }
+
+  const double max_offset = cfg.max_phi_offset * TMath::DegToRad();
+  const size_t ncells = size_t(cfg.nphi) * cfg.ntheta;
+  std::vector<int> npairs(ncells, 0);
+
+  // precompute the direction cosines of the grid
+  SkyMap grid(cfg);
+  std::vector<double> cos_phi(cfg.nphi), sin_phi(cfg.nphi), cos_theta(cfg.ntheta), sin_theta(cfg.ntheta);
+  for (int iphi = 0; iphi < cfg.nphi; iphi++)
+  {
+    cos_phi[iphi] = cos(grid.phi(iphi) * TMath::DegToRad());
+    sin_phi[iphi] = sin(grid.phi(iphi) * TMath::DegToRad());
+  }
+  for (int itheta = 0; itheta < cfg.ntheta; itheta++)
+  {
+    cos_theta[itheta] = cos(grid.theta(itheta) * TMath::DegToRad());
+    sin_theta[itheta] = sin(grid.theta(itheta) * TMath::DegToRad());
+  }
+
+  std::vector<char> mask(cfg.nphi);
+  for (size_t i = 0; i < chans.size(); i++)
+  {
+    for (size_t j = i+1; j < chans.size(); j++)
+    {
+      // azimuths both antennas can see
+      int nvisible = 0;
+      for (int iphi = 0; iphi < cfg.nphi; iphi++)
+      {
+        double phi = grid.phi(iphi) * TMath::DegToRad();
+        mask[iphi] = fabs(GeomTool::getPhiDiff(phi, az[i])) < max_offset && fabs(GeomTool::getPhiDiff(phi, az[j])) < max_offset;
+        nvisible += mask[iphi];
+      }
+      if (!nvisible) continue;
+
+      // the visible bins are contiguous (modulo the grid), find where they start
+      int start = 0;
+      if (nvisible < cfg.nphi)
+      {
+        while (!(mask[start] && !mask[(start + cfg.nphi - 1) % cfg.nphi])) start++;
+      }
+
+      Pair p;
+      p.iphi0 = start;
+      p.nphi = nvisible;
+      p.offset = delays.size();
+      pairs.push_back(p);
+      chan_pairs.emplace_back(chans[i], chans[j]);
+
+      const double dx = x[j] - x[i];
+      const double dy = y[j] - y[i];
+      const double dz = z[j] - z[i];
+      for (int itheta = 0; itheta < cfg.ntheta; itheta++)
+      {
+        for (int k = 0; k < nvisible; k++)
+        {
+          int iphi = (start + k) % cfg.nphi;
+          double nx = cos_theta[itheta] * cos_phi[iphi];
+          double ny = cos_theta[itheta] * sin_phi[iphi];
+          double nz = sin_theta[itheta];
+          delays.push_back((dx * nx + dy * ny + dz * nz) / C_M_PER_NS);
+          npairs[itheta * cfg.nphi + iphi]++;
+        }
+      }
+    }
+  }
+
+  norm.resize(ncells);
+  for (size_t i = 0; i < ncells; i++) norm[i] = npairs[i] ? 1.f / npairs[i] : 0.f;
+}
+
+
+void pueo::SkyMapper::compute(const UsefulEvent & ev, SkyMap & map, int nthreads) const
+{
+  CorrelationCache cache(cfg.upsample);
+  cache.setEvent(ev);
+  compute(cache, map, nthreads);
+}
+
+
+void pueo::SkyMapper::compute(CorrelationCache & cache, SkyMap & map, int nthreads) const
+{
+  map.reset(cfg);
+  map.pol = pol;
+  map.eventNumber = cache.getEventNumber();
+
+  cache.prepare(chan_pairs, nthreads);
+
+  // resolve everything per pair once, so the inner loop is just the table walk
+  const long LU = cache.getLength();
+  std::vector<const float*> corrs(pairs.size());
+  std::vector<double> lag_offset(pairs.size()), bins_per_ns(pairs.size());
+  for (size_t ipair = 0; ipair < pairs.size(); ipair++)
+  {
+    const ChanPair & cp = chan_pairs[ipair];
+    corrs[ipair] = cache.findCorrelation(cp.first, cp.second);
+    lag_offset[ipair] = cache.getLagOffset(cp.first, cp.second);
+    bins_per_ns[ipair] = 1. / cache.getLagStep(cp.first, cp.second);
+  }
+
+  // each row of the map is independent
+  parallel::forEach(cfg.ntheta, nthreads, [&](size_t itheta)
+  {
+    float * row = &map.values[itheta * cfg.nphi];
+    for (size_t ipair = 0; ipair < pairs.size(); ipair++)
+    {
+      const Pair & p = pairs[ipair];
+      const float * corr = corrs[ipair];
+      const float * d = &delays[p.offset + itheta * p.nphi];
+      for (int k = 0; k < p.nphi; k++)
+      {
+        double idx = (d[k] - lag_offset[ipair]) * bins_per_ns[ipair];
+        double fl = floor(idx);
+        double frac = idx - fl;
+        long j = long(fl) % LU;
+        if (j < 0) j += LU;
+        long j1 = j + 1 == LU ? 0 : j + 1;
+        int iphi = p.iphi0 + k;
+        if (iphi >= cfg.nphi) iphi -= cfg.nphi;
+        row[iphi] += (1 - frac) * corr[j] + frac * corr[j1];
+      }
+    }
+    const float * n = &norm[itheta * cfg.nphi];
+    for (int iphi = 0; iphi < cfg.nphi; iphi++) row[iphi] *= n[iphi];
+  });
+}
@@ -0,0 +1,161 @@
+/****************************************************************************************
+*  Spectrum.cc            Per-channel power spectra
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/Spectrum.h"
+#include "pueo/FFT.h"
+#include "pueo/UsefulEvent.h"
+#include "pueo/RawHeader.h"
+#include "pueo/Dataset.h"
+#include "pueo/GeomTool.h"
+#include "parallel.h"
+
+#include "TGraph.h"
+#include "TAxis.h"
+
+#include <cmath>
+#include <memory>
+
+
+static TGraph * makePsdGraph(size_t chan, double df, bool dB, const double * psd)
+{
+  TGraph * g = new TGraph(pueo::PowerSpectra::NFREQ);
+  for (size_t i = 0; i < pueo::PowerSpectra::NFREQ; i++)
+  {
+    g->GetX()[i] = i * df;
+    g->GetY()[i] = dB ? 10*log10(psd[i]) : psd[i];
+  }
+
+  int ant;
+  pueo::pol::pol_t pol;
+  pueo::GeomTool::Instance().getAntPolFromChanIndex(chan,ant,pol);
+  g->SetName(Form("psd_ant%d%c", ant, pueo::pol::asChar(pol)));
+  g->SetTitle(Form("Antenna %d%c", ant, pueo::pol::asChar(pol)));
+  g->GetXaxis()->SetTitle("f [GHz]");
+  g->GetYaxis()->SetTitle(dB ? "PSD [dB (mV^{2}/GHz)]" : "PSD [mV^{2}/GHz]");
+  g->SetBit(TGraph::kIsSortedX);
+  return g;
+}
+
+
+void pueo::PowerSpectra::compute(const UsefulEvent & ev, int nthreads)
+{
+  const FFT & fft = FFT::get(k::NUM_SAMPLES);
+  parallel::forEach(k::NUM_RF_CHANNELS, nthreads, [&](size_t ichan)
+  {
+    fft.power(&ev.volts[ichan][0], &psd[ichan][0], ev.dt[ichan]);
+    df[ichan] = 1. / (k::NUM_SAMPLES * ev.dt[ichan]);
+  });
+}
+
+
+void pueo::PowerSpectra::compute(size_t n, const UsefulEvent * const * events, PowerSpectra * out, int nthreads)
+{
+  const FFT & fft = FFT::get(k::NUM_SAMPLES);
+  parallel::forEach(n * k::NUM_RF_CHANNELS, nthreads, [&](size_t i)
+  {
+    size_t iev = i / k::NUM_RF_CHANNELS;
+    size_t ichan = i % k::NUM_RF_CHANNELS;
+    const UsefulEvent & ev = *events[iev];
+    fft.power(&ev.volts[ichan][0], &out[iev].psd[ichan][0], ev.dt[ichan]);
+    out[iev].df[ichan] = 1. / (k::NUM_SAMPLES * ev.dt[ichan]);
+  });
+}
+
+
+TGraph * pueo::PowerSpectra::makeGraph(size_t chan, bool dB) const
+{
+  if (chan >= k::NUM_RF_CHANNELS) return 0;
+  return makePsdGraph(chan, df[chan], dB, &psd[chan][0]);
+}
+
+
+bool pueo::AverageSpectrum::isMinBias(const RawHeader & h)
+{
+  return !trigger::isRFTrigger(h.trigType);
+}
+
+
+void pueo::AverageSpectrum::reset()
+{
+  N = 0;
+  for (auto & s : sum) s.fill(0);
+  df.fill(0);
+}
+
+
+void pueo::AverageSpectrum::add(const PowerSpectra & ps)
+{
+  for (size_t ichan = 0; ichan < k::NUM_RF_CHANNELS; ichan++)
+  {
+    for (size_t i = 0; i < NFREQ; i++) sum[ichan][i] += ps.psd[ichan][i];
+  }
+  df = ps.df;
+  N++;
+}
+
+
+bool pueo::AverageSpectrum::add(const UsefulEvent & ev, const RawHeader & h, int nthreads)
+{
+  if (!isMinBias(h)) return false;
+  // this is big, so keep one around per thread rather than allocating it every event
+  thread_local std::unique_ptr<PowerSpectra> ps;
+  if (!ps) ps.reset(new PowerSpectra);
+  ps->compute(ev, nthreads);
+  add(*ps);
+  return true;
+}
+
+
+Long64_t pueo::AverageSpectrum::addRun(Dataset & d, int nthreads, Long64_t max_events)
+{
+  Long64_t nadded = 0;
+  for (int i = 0; i < d.N(); i++)
+  {
+    if (max_events >= 0 && nadded >= max_events) break;
+    d.getEntry(i);
+    const RawHeader * h = d.header();
+    if (!h || !isMinBias(*h)) continue; // don't load the waveforms unless we need them
+    const UsefulEvent * ev = d.useful();
+    if (!ev) continue;
+    if (add(*ev, *h, nthreads)) nadded++;
+  }
+  return nadded;
+}
+
+
+void pueo::AverageSpectrum::getAverage(size_t chan, double * out) const
+{
+  for (size_t i = 0; i < NFREQ; i++) out[i] = getAverage(chan,i);
+}
+
+
+TGraph * pueo::AverageSpectrum::makeGraph(size_t chan, bool dB) const
+{
+  if (chan >= k::NUM_RF_CHANNELS) return 0;
+  std::array<double, NFREQ> avg;
+  getAverage(chan, &avg[0]);
+  TGraph * g = makePsdGraph(chan, df[chan], dB, &avg[0]);
+  g->SetTitle(Form("%s (average of %lld)", g->GetTitle(), N));
+  return g;
+}
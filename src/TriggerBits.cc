@@ -0,0 +1,70 @@
+/****************************************************************************************
+*  TriggerBits.cc            Bulk decoding of L2 masks into phi-sector bitsets
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#include "pueo/TriggerBits.h"
+#include "pueo/RawHeader.h"
+#include "pueo/DaqHsk.h"
+
+
+void pueo::triggerbits::triggeredPhis(const UInt_t * L2Masks, size_t n, UInt_t * out)
+{
+  for (size_t i = 0; i < n; i++) triggeredPhis(L2Masks[i], out + 2*i);
+}
+
+
+void pueo::triggerbits::triggeredPhis(const RawHeader * headers, size_t n, UInt_t * out)
+{
+  for (size_t i = 0; i < n; i++) triggeredPhis(headers[i].L2Mask, out + 2*i);
+}
+
+
+void pueo::triggerbits::triggeredPhis(const RawHeader * const * headers, size_t n, UInt_t * out)
+{
+  for (size_t i = 0; i < n; i++) triggeredPhis(headers[i]->L2Mask, out + 2*i);
+}
+
+
+void pueo::triggerbits::excludedPhis(const UInt_t * l2_enable_masks, size_t n, UInt_t * out)
+{
+  for (size_t i = 0; i < n; i++) excludedPhis(l2_enable_masks[i], out + 2*i);
+}
+
+
+void pueo::triggerbits::excludedPhis(const daqhsk::DaqHsk * const * hsks, size_t n, UInt_t * out)
+{
+  for (size_t i = 0; i < n; i++) excludedPhis(hsks[i]->l2_enable_mask, out + 2*i);
+}
+
+
+void pueo::triggerbits::usablePhis(const RawHeader * const * headers, const daqhsk::DaqHsk * const * hsks, size_t n, UInt_t * out)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    UInt_t enabled = hsks && hsks[i] ? hsks[i]->l2_enable_mask : 0xffffff;
+    for (int pol = 0; pol < 2; pol++)
+    {
+      out[2*i + pol] = triggeredPhis(headers[i]->L2Mask, pol) & ~excludedPhis(enabled, pol);
+    }
+  }
+}
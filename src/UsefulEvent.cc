@@ -25,38 +25,38 @@
 #include "pueo/UsefulEvent.h" 
 #include "pueo/GeomTool.h" 
 #include "pueo/RawHeader.h" 
+#include "pueo/Calibration.h" 
 
 #include "TGraph.h"
 #include "TAxis.h" 
 
+#include <algorithm>
+
 
 
 
 pueo::UsefulEvent::UsefulEvent(const RawEvent & event, const RawHeader & header) 
   : RawEvent(event)
 {
-  (void) header; 
-
-
-
-  auto geom = GeomTool::Instance(); 
-
-  auto flight_geom = GeomTool::Instance(0,"flight");
+  // default geometry channel -> flight channel (i.e. index into data) 
+  const auto & chan_map = GeomTool::Instance().getDataChanMap(); 
+  auto cal = Calibration::get(header.run ? (int) header.run : runNumber); 
 
   for (size_t ichan = 0; ichan < k::NUM_RF_CHANNELS; ichan++) 
   {
-
-    int ant;
-    pueo::pol::pol_t pol;
-    geom.getAntPolFromChanIndex(ichan, ant,pol);
-
-    int flight_chan = flight_geom.getChanIndexFromAntPol(ant,pol);
-    for (size_t i = 0; i < volts[ichan].size(); i++) 
+    int flight_chan = chan_map[ichan]; 
+    if (flight_chan < 0) 
     {
-      volts[ichan][i] = data[flight_chan][i] *500./2048 ; // TODO: CALIBRATION
+      volts[ichan].fill(0); 
+      t0[ichan] = 0; 
+      dt[ichan] = 1/3.; 
+    }
+    else
+    {
+      cal->apply(flight_chan, &data[flight_chan][0], &volts[ichan][0]); 
+      t0[ichan] = cal->t0[flight_chan]; 
+      dt[ichan] = cal->dt[flight_chan]; 
     }
-    t0[ichan] = 0;//TODO!!!  will likely depend on trigger type or something... 
-    dt[ichan] = 1/3.;
   }
 
 }
@@ -81,17 +81,13 @@ TGraph * pueo::UsefulEvent::makeGraph(int surf, int chan) const
 
 TGraph * pueo::UsefulEvent::makeGraph(size_t chanIndex) const
 {
-  if (chanIndex >= k::NUM_DIGITIZED_CHANNELS) return 0; 
+  if (chanIndex >= k::NUM_RF_CHANNELS) return 0; 
   TGraph * g = new TGraph(volts[chanIndex].size()); 
   int ant; 
   pol::pol_t pol; 
 
   GeomTool::Instance().getAntPolFromChanIndex(chanIndex,ant,pol); 
-  for (size_t i = 0; i < volts[chanIndex].size(); i++) 
-  {
-    g->GetY()[i] = volts[chanIndex][i]; 
-    g->GetX()[i] = i * dt[chanIndex] + t0[chanIndex]; 
-  }
+  fillGraph(chanIndex, g); 
   g->SetName(Form("ant%d%c", ant, pol::asChar(pol))); 
   g->SetTitle(Form("Antenna %d%c", ant, pol::asChar(pol))); 
   g->GetXaxis()->SetTitle("t [ns]"); 
@@ -100,9 +96,23 @@ TGraph * pueo::UsefulEvent::makeGraph(size_t chanIndex) const
   g->SetBit(TGraph::kNotEditable);
 
   return g; 
-} 
+}
 
 
+void pueo::UsefulEvent::fillGraph(size_t chanIndex, TGraph * g) const
+{
+  if (chanIndex >= k::NUM_RF_CHANNELS || !g) return; 
 
+  const int N = volts[chanIndex].size(); 
+  if (g->GetN() != N) g->Set(N); 
 
+  double * x = g->GetX(); 
+  double * y = g->GetY(); 
+  const double t0_ = t0[chanIndex]; 
+  const double dt_ = dt[chanIndex]; 
+  std::copy(volts[chanIndex].begin(), volts[chanIndex].end(), y); 
+  for (int i = 0; i < N; i++) x[i] = i * dt_ + t0_; 
 
+  // the points were changed in place, so have the axis range recomputed (keeping the titles) on the next draw
+  g->SetBit(TGraph::kResetHisto); 
+}
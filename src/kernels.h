@@ -0,0 +1,52 @@
+/****************************************************************************************
+*  kernels.h              Internal waveform kernels
+*
+*  Not installed. These are the inner loops shared by UsefulEvent and friends. They are
+*  compiled for several instruction sets (see Kernels.cc) and the best one is picked at
+*  load time, so callers should just call them on whole channels.
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_KERNELS_H
+#define PUEO_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pueo
+{
+  namespace kernels
+  {
+    /** out[i] = in[i] * scale + offset */
+    void convert(const int16_t * in, double * out, size_t n, double scale, double offset);
+    void convert(const int16_t * in, float * out, size_t n, float scale, float offset);
+
+    /** out[i] = lut[clamp(in[i] + lut_offset, 0, lut_size-1)] */
+    void lookup(const int16_t * in, double * out, size_t n, const float * lut, int lut_offset, int lut_size);
+    void lookup(const int16_t * in, float * out, size_t n, const float * lut, int lut_offset, int lut_size);
+
+    /** Delay-and-sum nchan channels (channel c shifted later by delays[c] samples), square, and
+     *  return the largest sum of that over window consecutive samples. work needs room for 2n floats. */
+    float beamPower(const int16_t * const * in, const int * delays, size_t nchan, size_t n, size_t window, float * work);
+  }
+}
+
+#endif
@@ -0,0 +1,82 @@
+/****************************************************************************************
+*  parallel.h              Internal helper for splitting work across threads
+*
+*  Not installed. 
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_PARALLEL_H
+#define PUEO_PARALLEL_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+namespace pueo
+{
+  namespace parallel
+  {
+    /** Number of threads to actually use: n <= 0 means all hardware threads */
+    inline int nthreads(int n)
+    {
+      if (n > 0) return n;
+      int hw = std::thread::hardware_concurrency();
+      return hw > 0 ? hw : 1;
+    }
+
+    /** Calls f(i, ithread) for i in [0,n), spread dynamically over up to nthreads threads (including this one).
+     *  ithread is in [0, nthreads(nthr)), for indexing per-thread accumulators. */
+    template <typename F>
+    void forEachWithThread(size_t n, int nthr, F && f)
+    {
+      nthr = nthreads(nthr);
+      if (size_t(nthr) > n) nthr = n;
+      if (nthr <= 1)
+      {
+        for (size_t i = 0; i < n; i++) f(i, 0);
+        return;
+      }
+
+      std::atomic<size_t> next(0);
+      auto work = [&](int ithread)
+      {
+        size_t i;
+        while ((i = next++) < n) f(i, ithread);
+      };
+
+      std::vector<std::thread> threads;
+      threads.reserve(nthr-1);
+      for (int t = 1; t < nthr; t++) threads.emplace_back(work, t);
+      work(0);
+      for (auto & t : threads) t.join();
+    }
+
+    /** Calls f(i) for i in [0,n), spread dynamically over up to nthreads threads (including this one) */
+    template <typename F>
+    void forEach(size_t n, int nthr, F && f)
+    {
+      forEachWithThread(n, nthr, [&](size_t i, int) { f(i); });
+    }
+  }
+}
+
+#endif
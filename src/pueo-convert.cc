@@ -3,24 +3,57 @@
 #include <iostream>
 #include <vector>
 #include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <atomic>
+
+static std::atomic<bool> stop_watching(false);
+
+static void handle_stop(int)
+{
+  stop_watching = true;
+}
 
 void usage()
 {
 
-  std::cout << "Usage: pueo-convert [-f] [-t tmpsuf] [-s sortby] [-P postprocessor args] typetag outfile.root input [input2]                                 \n"
+  std::cout << "Usage: pueo-convert [-f] [-a] [-j nthreads] [-t tmpsuf] [-s sortby] [-M sortmb] [-C objective [-N entries]] [-c tuned.root] [-L layout] [-J stats.json] [-P postprocessor args] typetag outfile.root input [input2]                   \n"
                "   -f   allow clobbering output                                                                                                              \n"
+               "   -a   append to an existing output: only input files (or the ends of files) not already converted into it are read. For growing runs.    \n"
+               "        With -s, appended entries are sorted among themselves only: if they belong before existing ones, only the index is sorted (warns).\n"
+               "   -j   number of threads decoding input files (and compressing output), 0 for all cores. Output order doesn't depend on this.            \n"
                "   -t   set a temporary file suffix                                                                                                          \n"
                "   -s   sort by an expression (quotes for complex expression, anything that goes in TTree::Draw and produces a double will work).            \n"
                "        Mostly useful for telemetered data. A useful expression may be \"run*1e9+event\".                                                    \n"
+               "        Entries are sorted as they're read, so nearly sorted input costs nothing extra.                                                      \n"
+               "   -M   memory (MB, default 256) for entries waiting to be sorted. Input out of order by more than this is merged from sorted runs at the end.\n"
+               "   -C   tune compression per branch for smallest, fastest (decode) or balanced, by trying candidate settings on the first entries.    \n"
+               "        The choices are recorded in the output.                                                                                      \n"
+               "   -N   number of entries to tune on (default 200)                                                                                   \n"
+               "   -c   reuse the compression choices recorded in these (comma-separated) tuned outputs instead of tuning                            \n"
+               "   -L   output layout: sequential (big clusters, for reading everything) or random (small entry-aligned clusters, for single events)\n"
                "   -P   post processor args (quote for multiple)                                                                                             \n"
+               "   -J   write conversion statistics as JSON to this file (default none)                                                               \n"
                "   typetag  typetag of input, or use auto to try to determine (problematic if more than one ROOT type can be generate from the same raw type)\n"
-               "   outfile  name of output file                                                                                                              \n"
+               "            Several typetags sharing a raw type can be given separated by commas (e.g. header,event) to write them in one pass over the input.\n"
+               "            A :N suffix (e.g. header:10) keeps only every Nth entry.                                                                          \n"
+               "   outfile  name of output file, or comma-separated names matching the typetags                                                              \n"
                "   input    name(s) of input files or directories. Note that directories are not recursive.                                                  \n"
                "            So, as an example, converting all timemarks (file structure timemarks/<year>_<month>_<day>/*.timemark.dat) into one root file,   \n"
                "            one would have to pass `/path/to/timemark/*` instead of `/path/to/timemark/`                                                   \n\n" 
 
                "            As another example: on the other hand, converting one day's worth of timemarks,                                                  \n"
                "            simply pass the directory path `/path/to/timemark/<year>_<month>_<day>/`                                                         \n"
+               "\n"
+               "       pueo-convert --watch [-O outdir] [-R maxmb] [-w settle] [options above] typetag outbase rawdir [rawdir2]                         \n"
+               "   Watch raw directories (recursively) and convert files as they are closed or moved in, until interrupted.                            \n"
+               "   Outputs are outdir/run<N>/<outbase><N>.root (e.g. outbase headFile), taking the run from a run<N> directory in the input path,    \n"
+               "   and each update is renamed into place so readers always see a complete file.                                                      \n"
+               "   -O   output directory (default .)                                                                                                 \n"
+               "   -R   start a new part (<outbase><N>_1.root, ...) once an output is bigger than this many MB (default 64).                          \n"
+               "        Each update rewrites the current part, so this bounds the I/O and latency of an update: smaller means faster updates,        \n"
+               "        but more part files for readers to chain.                                                                                    \n"
+               "   -w   seconds without new files before converting what has arrived (default 1)                                                   \n"
     << std::endl;
 }
 
@@ -29,12 +62,36 @@ int main(int nargs, char ** args)
   char * typetag = NULL;
   char * output = NULL;
   pueo::convert::ConvertOpts opts;
+  pueo::convert::WatchOpts wopts;
+  bool watch = false;
 
   std::vector<char *> inputs;
 #define CHECK_NOT_LAST if (i == nargs -1) { usage(); return 1; }
   for (int i = 1; i < nargs; i++)
   {
     if (!strcmp(args[i],"-f")) opts.clobber = true;
+    else if (!strcmp(args[i],"-a")) opts.append = true;
+    else if (!strcmp(args[i],"--watch")) watch = true;
+    else if (!strcmp(args[i],"-O"))
+    {
+      CHECK_NOT_LAST
+      wopts.outdir = args[++i];
+    }
+    else if (!strcmp(args[i],"-R"))
+    {
+      CHECK_NOT_LAST
+      wopts.max_output_mb = atoi(args[++i]);
+    }
+    else if (!strcmp(args[i],"-w"))
+    {
+      CHECK_NOT_LAST
+      wopts.settle = atof(args[++i]);
+    }
+    else if (!strcmp(args[i],"-j"))
+    {
+      CHECK_NOT_LAST
+      opts.nthreads = atoi(args[++i]);
+    }
     else if (!strcmp(args[i],"-t"))
     {
       CHECK_NOT_LAST
@@ -50,6 +107,43 @@ int main(int nargs, char ** args)
       CHECK_NOT_LAST
       opts.sort_by = args[++i];
     }
+    else if (!strcmp(args[i],"-J"))
+    {
+      CHECK_NOT_LAST
+      opts.stats_file = args[++i];
+    }
+    else if (!strcmp(args[i],"-M"))
+    {
+      CHECK_NOT_LAST
+      opts.sort_buffer_mb = atoi(args[++i]);
+    }
+    else if (!strcmp(args[i],"-C"))
+    {
+      CHECK_NOT_LAST
+      const char * objective = args[++i];
+      if (!strcmp(objective,"smallest")) opts.compression_tuning = pueo::convert::kSmallest;
+      else if (!strcmp(objective,"fastest")) opts.compression_tuning = pueo::convert::kFastestDecode;
+      else if (!strcmp(objective,"balanced")) opts.compression_tuning = pueo::convert::kBalanced;
+      else { usage(); return 1; }
+    }
+    else if (!strcmp(args[i],"-L"))
+    {
+      CHECK_NOT_LAST
+      const char * layout = args[++i];
+      if (!strcmp(layout,"sequential")) opts.layout = pueo::convert::kSequential;
+      else if (!strcmp(layout,"random")) opts.layout = pueo::convert::kRandomAccess;
+      else { usage(); return 1; }
+    }
+    else if (!strcmp(args[i],"-N"))
+    {
+      CHECK_NOT_LAST
+      opts.tune_entries = atoi(args[++i]);
+    }
+    else if (!strcmp(args[i],"-c"))
+    {
+      CHECK_NOT_LAST
+      opts.compression_from = args[++i];
+    }
     else if (!typetag)
     {
       typetag = args[i];
@@ -75,6 +169,16 @@ int main(int nargs, char ** args)
   }
 
 
+  if (watch)
+  {
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+    wopts.stop = &stop_watching;
+    int Nproc = pueo::convert::watchDirectories(typetag, output, inputs.size(), (const char **) &inputs[0], wopts, opts);
+    std::cout << "Converted " << Nproc << " entries" << std::endl;
+    return Nproc < 0 ? 1 : 0;
+  }
+
   int Nproc = pueo::convert::convertFilesOrDirectories(typetag,
         inputs.size(), (const char **) &inputs[0],
         output, opts);
@@ -86,7 +190,7 @@ int main(int nargs, char ** args)
   }
   else
   {
-    std::cout << "Processed " << Nproc << " files" << std::endl;
+    std::cout << "Converted " << Nproc << " entries" << std::endl;
   }
 
 
@@ -0,0 +1,166 @@
+#include "pueo/Converter.h"
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Rewrites a converted tree with each layout profile and measures what readers care about:
+ * the latency of reading single random entries (as the event display and playlist jobs do)
+ * and the throughput of reading everything in order.
+ */
+
+void usage()
+{
+  std::cout << "Usage: pueo-layout-bench [-n nrandom] [-o outdir] [-k] typetag converted.root            \n"
+               "   -n   number of random single-entry reads (default 1000)                                \n"
+               "   -o   where to write the rewritten files (default .)                                    \n"
+               "   -k   keep the rewritten files                                                          \n"
+               "   typetag  the type in the file (e.g. event, header), which picks the layouts            \n"
+               "Files are read back right after they're written, so they're likely in the page cache:    \n"
+               "this measures decompression and deserialization more than the disk.                       \n"
+    << std::endl;
+}
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool rewrite(TTree * in, const char * typetag, pueo::convert::layout_t profile, const char * outname, int compression)
+{
+  TFile f(outname, "RECREATE");
+  if (!f.IsOpen()) return false;
+  f.SetCompressionSettings(compression);
+  TTree * out = in->CloneTree(0);
+  out->SetAutoSave(0);
+  pueo::convert::applyLayout(out, typetag, profile);
+  for (Long64_t i = 0; i < in->GetEntries(); i++)
+  {
+    in->GetEntry(i);
+    out->Fill();
+  }
+  out->Write();
+  f.Close();
+  in->ResetBranchAddresses();
+  return true;
+}
+
+static void measure(const char * name, const char * fname, const char * treename, int nrandom)
+{
+  struct stat st;
+  stat(fname, &st);
+
+  double seq_s = 0, tot_mb = 0;
+  Long64_t N = 0, nclusters = 0;
+  {
+    TFile f(fname);
+    TTree * t = f.Get<TTree>(treename);
+    N = t->GetEntries();
+    tot_mb = t->GetTotBytes() / 1048576.;
+    auto it = t->GetClusterIterator(0);
+    while (it() < N) nclusters++;
+
+    auto start = std::chrono::steady_clock::now();
+    for (Long64_t i = 0; i < N; i++) t->GetEntry(i);
+    seq_s = seconds(start);
+  }
+
+  std::vector<double> lat;
+  {
+    TFile f(fname);
+    TTree * t = f.Get<TTree>(treename);
+    // a readahead cache only gets in the way of reading single entries
+    t->SetCacheSize(0);
+    std::mt19937_64 rng(12345);
+    std::uniform_int_distribution<Long64_t> pick(0, N-1);
+    for (int i = 0; i < nrandom; i++)
+    {
+      Long64_t entry = pick(rng);
+      auto start = std::chrono::steady_clock::now();
+      t->GetEntry(entry);
+      lat.push_back(seconds(start) * 1e3);
+    }
+  }
+  std::sort(lat.begin(), lat.end());
+
+  printf("%-14s %10.1f %9lld %12.3f %12.3f %12.1f %12.1f\n", name, st.st_size / 1048576., (long long) nclusters,
+      lat.size() ? lat[lat.size()/2] : 0., lat.size() ? lat[std::min(lat.size()-1, lat.size() * 99 / 100)] : 0.,
+      seq_s > 0 ? N / seq_s : 0., seq_s > 0 ? tot_mb / seq_s : 0.);
+}
+
+int main(int nargs, char ** args)
+{
+  const char * typetag = nullptr;
+  const char * infile = nullptr;
+  const char * outdir = ".";
+  int nrandom = 1000;
+  bool keep = false;
+
+#define CHECK_NOT_LAST if (i == nargs -1) { usage(); return 1; }
+  for (int i = 1; i < nargs; i++)
+  {
+    if (!strcmp(args[i],"-n"))
+    {
+      CHECK_NOT_LAST
+      nrandom = atoi(args[++i]);
+    }
+    else if (!strcmp(args[i],"-o"))
+    {
+      CHECK_NOT_LAST
+      outdir = args[++i];
+    }
+    else if (!strcmp(args[i],"-k")) keep = true;
+    else if (!typetag) typetag = args[i];
+    else if (!infile) infile = args[i];
+    else { usage(); return 1; }
+  }
+
+  if (!typetag || !infile)
+  {
+    usage();
+    return 1;
+  }
+
+  std::string treename = std::string(typetag) + "Tree";
+  TFile fin(infile);
+  TTree * in = fin.IsOpen() ? fin.Get<TTree>(treename.c_str()) : nullptr;
+  if (!in || !in->GetEntries())
+  {
+    std::cerr << "No " << treename << " (or no entries) in " << infile << std::endl;
+    return 1;
+  }
+
+  struct { const char * name; pueo::convert::layout_t profile; } profiles[] = {
+    { "default", pueo::convert::kDefaultLayout },
+    { "sequential", pueo::convert::kSequential },
+    { "random-access", pueo::convert::kRandomAccess }
+  };
+
+  printf("%s: %lld entries, %d random reads\n", treename.c_str(), (long long) in->GetEntries(), nrandom);
+  printf("%-14s %10s %9s %12s %12s %12s %12s\n", "layout", "size (MB)", "clusters", "median (ms)", "p99 (ms)", "seq entry/s", "seq MB/s");
+
+  for (const auto & p : profiles)
+  {
+    std::string outname = std::string(outdir) + "/layout-bench-" + p.name + ".root";
+    if (!rewrite(in, typetag, p.profile, outname.c_str(), fin.GetCompressionSettings()))
+    {
+      std::cerr << "Couldn't write " << outname << std::endl;
+      return 1;
+    }
+    measure(p.name, outname.c_str(), treename.c_str(), nrandom);
+    if (!keep) unlink(outname.c_str());
+  }
+
+  return 0;
+}
@@ -0,0 +1,100 @@
+/****************************************************************************************
+*  pueo/BeamEmulator.h              Software replay of the SURF beamforming trigger
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_BEAM_EMULATOR_H
+#define PUEO_BEAM_EMULATOR_H
+
+#include "Rtypes.h"
+#include "pueo/Conventions.h"
+#include <array>
+
+namespace pueo
+{
+  class RawEvent;
+  class GeomTool;
+  class Dataset;
+  namespace daqhsk
+  {
+    class DaqHsk;
+  }
+
+  /** How the beams are formed. Each SURF forms k::NUM_BEAMS beams out of its k::NUM_CHANS_PER_SURF
+   * channels (RawEvent::data[surf * NUM_CHANS_PER_SURF + chan]) */
+  struct BeamConfig
+  {
+    /** Delay (in samples) applied to each channel of each beam of each SURF. Negative means leave the channel out. */
+    std::array<std::array<std::array<Short_t, k::NUM_CHANS_PER_SURF>, k::NUM_BEAMS>, k::NUM_SURF_SLOTS> delays;
+
+    int window = 8;              ///< number of samples the beam power is summed over
+    double threshold_scale = 1;  ///< beam power (ADC counts^2, summed over the window) per unit of daqhsk threshold
+
+    /** No delays (every beam looks straight out) */
+    BeamConfig();
+
+    /** Beams spaced evenly in elevation between el_min and el_max (degrees), with delays from
+     * the heights of each SURF's antennas in geom (by default the flight geometry) */
+    static BeamConfig fromGeometry(double el_min = -60, double el_max = 30, const GeomTool * geom = nullptr);
+  };
+
+
+  /** What the emulator found for one event */
+  struct BeamResult
+  {
+    std::array<std::array<Float_t, k::NUM_BEAMS>, k::NUM_SURF_SLOTS> power;  ///< largest windowed beam power
+    std::array<std::array<Float_t, k::NUM_BEAMS>, k::NUM_SURF_SLOTS> margin; ///< power / threshold (0 if no threshold)
+    std::array<ULong64_t, k::NUM_SURF_SLOTS> fired; ///< bit b is set if beam b went over threshold (and isn't masked)
+
+    bool fires(int surf, int beam) const { return fired[surf] >> beam & 1; }
+    int nFired() const;
+  };
+
+
+  //!  pueo::BeamEmulator -- replays the beamforming trigger on recorded waveforms
+  /*!
+    Each beam is a delay-and-sum of its SURF's channels. The sum is squared, summed over
+    BeamConfig::window samples, and the largest value over the waveform is compared
+    to the beam's threshold from the DaqHsk in effect at the event time. Beams with
+    inMask set are treated as masked off. Beams with a zero threshold never fire.
+
+    This works on RawEvent::data (ADC counts), so it needs raw files. In Dataset's
+    compact mode, raw() returns zeroed data.
+  */
+  class BeamEmulator
+  {
+    public:
+      BeamEmulator(const BeamConfig & c = BeamConfig::fromGeometry()) : cfg(c) { ; }
+
+      /** Emulate one event. nthreads spreads the SURFs over threads (<= 0 means all hardware threads) */
+      void emulate(const RawEvent & ev, const daqhsk::DaqHsk & hsk, BeamResult & out, int nthreads = 1) const;
+
+      /** Emulate the Dataset's current event, with the daqhsk nearest to it. Returns 0 on success, -1 if something is missing. */
+      int emulate(Dataset & d, BeamResult & out, int nthreads = 1) const;
+
+      const BeamConfig & getConfig() const { return cfg; }
+
+    private:
+      BeamConfig cfg;
+  };
+}
+
+#endif
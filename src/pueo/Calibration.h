@@ -0,0 +1,104 @@
+/****************************************************************************************
+*  pueo/Calibration.h              Per-run waveform calibration
+*
+*  Holds the per-channel gain, pedestal, ADC nonlinearity and timing constants
+*  used to turn RawEvent::data into UsefulEvent::volts.
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_CALIBRATION_H
+#define PUEO_CALIBRATION_H
+
+#include "Rtypes.h"
+#include "pueo/Conventions.h"
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <string>
+
+
+namespace pueo
+{
+
+  //!  pueo::Calibration -- per-run waveform calibration constants
+  /*!
+    All arrays are indexed by the digitizer channel (i.e. the index into RawEvent::data), since
+    these are properties of the readout rather than of the antenna.
+
+    Calibrations are looked for in $PUEO_CALIB_DIR, falling back to
+    $PUEO_UTIL_INSTALL_DIR/share/pueoCalib. A file calib_run<N>.root applies to run N
+    and all later runs until the next such file. Each file has a TTree called "calib"
+    with one entry per channel and branches:
+
+       chan/I  gain/F (mV/count)  pedestal/F (counts)  t0/F (ns)  dt/F (ns)
+
+    and optionally nonlin[4096]/F mapping the raw ADC code (offset by 2048) to linearized counts.
+
+    If no file is found, the nominal constants (500/2048 mV/count, no pedestal, t0 = 0, dt = 1/3 ns) are used.
+
+    Calibrations are cached, so getting the same one repeatedly (e.g. when Dataset switches runs) does not touch the disk.
+  */
+  class Calibration
+  {
+    public:
+      static constexpr int LUT_SIZE = 4096;
+      static constexpr int LUT_OFFSET = 2048;
+
+      /** Get the calibration that applies to a run, loading it on first use */
+      static std::shared_ptr<const Calibration> get(int run);
+
+      /** How many distinct calibrations to keep in memory (default 8) */
+      static void setCacheSize(size_t n);
+
+      /** The directory that is searched for calibration files */
+      static std::string getCalibDir();
+
+      /** Apply the calibration to a whole channel (k::NUM_SAMPLES samples), producing mV. This is one fused pass. */
+      void apply(size_t chan, const Short_t * in, double * out) const;
+      void apply(size_t chan, const Short_t * in, float * out) const;
+
+      /** True if the channel is a pure linear transform (volts = counts * getScale() + getOffset()) */
+      bool isLinear(size_t chan) const { return lut_index[chan] < 0; }
+      float getScale(size_t chan) const { return gain[chan]; }
+      float getOffset(size_t chan) const { return -gain[chan] * pedestal[chan]; }
+
+      /** The first run this calibration applies to (or -1 for nominal constants) */
+      int getFirstRun() const { return first_run; }
+      const std::string & getSource() const { return source; }
+
+      std::array<float, k::NUM_DIGITIZED_CHANNELS> gain;     ///< mV / count
+      std::array<float, k::NUM_DIGITIZED_CHANNELS> pedestal; ///< counts
+      std::array<float, k::NUM_DIGITIZED_CHANNELS> t0;       ///< ns
+      std::array<float, k::NUM_DIGITIZED_CHANNELS> dt;       ///< ns
+
+    private:
+      Calibration();
+      bool load(const std::string & file);
+
+      int first_run = -1;
+      std::string source;
+      std::array<int, k::NUM_DIGITIZED_CHANNELS> lut_index;  ///< offset into fused_lut or -1
+      std::vector<float> fused_lut; ///< gain * (nonlin - pedestal), per channel with a nonlinearity table
+  };
+}
+
+#endif
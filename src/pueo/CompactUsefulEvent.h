@@ -0,0 +1,120 @@
+/****************************************************************************************
+*  pueo/CompactUsefulEvent.h              Compact storage for calibrated waveforms
+*
+*  A UsefulEvent carries both the int16 raw data and 208x1024 doubles, which is about
+*  2.1 MB per event. The CompactUsefulEvent stores the same waveforms either as
+*  single-precision volts or as int16 counts with a per-channel scale and offset,
+*  with volts derived on the fly.
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+
+#ifndef PUEO_COMPACT_USEFUL_EVENT_H
+#define PUEO_COMPACT_USEFUL_EVENT_H
+
+#include "Rtypes.h"
+#include "pueo/Conventions.h"
+
+#include <array>
+#include <vector>
+
+
+namespace pueo
+{
+  class RawEvent;
+  class RawHeader;
+  class UsefulEvent;
+
+  //!  pueo::CompactUsefulEvent -- calibrated waveforms in a compact representation
+  /*!
+    Channels are in the same (default geometry) order as UsefulEvent::volts.
+
+    In kDerived mode, waveforms are kept as int16 counts and volts are computed as
+    counts * scale + offset. When built from a RawEvent, counts are the ADC counts
+    (so this is lossless), when built from a UsefulEvent (e.g. by an MC producer)
+    the volts are quantized to 16 bits using the per-channel range.
+
+    In kFloat mode, waveforms are single-precision volts. Building from a RawEvent
+    switches to kFloat if the run's Calibration has an ADC nonlinearity table.
+
+    Derived mode is about 430 kB per event, float mode 850 kB, versus ~2.1 MB for UsefulEvent.
+    \ingroup rootclasses
+  */
+  class CompactUsefulEvent
+  {
+
+    public:
+      enum Precision
+      {
+        kFloat = 0,   ///< single-precision volts
+        kDerived = 1  ///< int16 counts with per-channel scale/offset
+      };
+
+      CompactUsefulEvent() { ; }
+
+      /** Build from raw data (as UsefulEvent would, using the run's Calibration) */
+      CompactUsefulEvent(const RawEvent & event, const RawHeader & header, Precision p = kDerived);
+
+      /** Build from a UsefulEvent, e.g. for MC producers that only want to write the compact form */
+      CompactUsefulEvent(const UsefulEvent & event, Precision p = kFloat);
+
+      Precision getPrecision() const { return Precision(precision); }
+
+      /** Get one sample in mV */
+      double volts(size_t chan, size_t i) const
+      {
+        return precision == kFloat ? fvolts[chan * k::NUM_SAMPLES + i]
+                                   : counts[chan * k::NUM_SAMPLES + i] * scale[chan] + offset[chan];
+      }
+
+      /** Fill a whole channel (k::NUM_SAMPLES samples) in mV */
+      void getVolts(size_t chan, double * out) const;
+      void getVolts(size_t chan, float * out) const;
+
+      double t(size_t chan, size_t i) const { return t0[chan] + i * dt[chan]; }
+
+      /** Expand into a full UsefulEvent. Note that the digitizer-ordered raw data is not kept, so useful.data will be zeroed. */
+      void toUseful(UsefulEvent & useful) const;
+
+      /** Flip the sign of all waveforms (e.g. for polarity blinding)  */
+      void invertPolarity();
+
+      ULong_t eventNumber = 0; ///< Event number
+      Int_t runNumber = 0;   ///< Run number
+      UChar_t precision = kDerived; ///< see Precision
+
+      std::array<Float_t, k::NUM_RF_CHANNELS> t0 = {};
+      std::array<Float_t, k::NUM_RF_CHANNELS> dt = {};
+      std::array<Float_t, k::NUM_RF_CHANNELS> scale = {};  ///< mV / count (kDerived only)
+      std::array<Float_t, k::NUM_RF_CHANNELS> offset = {}; ///< mV (kDerived only)
+
+      std::vector<Short_t> counts; ///< kDerived only, NUM_RF_CHANNELS * NUM_SAMPLES
+      std::vector<Float_t> fvolts; ///< kFloat only, NUM_RF_CHANNELS * NUM_SAMPLES
+
+
+    ClassDefNV(CompactUsefulEvent,1);
+  };
+}
+
+
+#endif
+
+
@@ -29,6 +29,10 @@
 
 
 #include "Compression.h"
+#include "Rtypes.h"
+#include <atomic>
+
+class TTree;
 
 
 #ifdef HAVE_PUEORAWDATA
@@ -64,6 +68,11 @@ namespace pueo
 // has_arity should be 1 in case a raw type corresponds to multiple root types, in which case an arity
 // template specialization below should also be defined
 //
+// hskseries is the compact form of hsk: only sensor, time and value per reading, with the
+// sensor names and types in a table (hskSensorTree) next to it, see pueo::hsk::SensorTable.
+// It's indexed by sensor then time, so one sensor's readings can be found without a scan.
+// When several types share a raw type, the last one is what auto picks, so hsk stays below it.
+//
 #define PUEO_CONVERTIBLE_TYPES(PUEO_CONVERT_TYPE)\
 /*                  |  tag           |     raw type        | ROOT type                |  postprocessor  | has_arity | index_major | minor   */\
 /*========================================================================================================================================================= */\
@@ -71,6 +80,7 @@ PUEO_CONVERT_TYPE(/*|*/ event,     /*|*/  full_waveforms, /*|*/ pueo::RawEvent,
 PUEO_CONVERT_TYPE(/*|*/ header,    /*|*/  full_waveforms, /*|*/ pueo::RawHeader,      /*|*/ nullptr,    /*|*/ 0,  /*|*/ "eventNumber" , /*|*/  "0"           )\
 PUEO_CONVERT_TYPE(/*|*/ attitude,  /*|*/  nav_att,        /*|*/ pueo::nav::Attitude,  /*|*/ nullptr,    /*|*/ 0,  /*|*/ "realTime", /*|*/  "realTimeNsecs"        )\
 PUEO_CONVERT_TYPE(/*|*/ sunsensors,/*|*/  ss,             /*|*/ pueo::nav::SunSensors,/*|*/ nullptr,    /*|*/ 0,  /*|*/ "readoutTime", /*|*/  "readoutTimeNsecs"  )\
+PUEO_CONVERT_TYPE(/*|*/ hskseries, /*|*/  sensors_disk,   /*|*/ pueo::hsk::Reading,   /*|*/ nullptr,    /*|*/ 1,  /*|*/ "sensor_id", /*|*/  "time_secs*1000+time_ms" )\
 PUEO_CONVERT_TYPE(/*|*/ hsk,       /*|*/  sensors_disk,   /*|*/ pueo::hsk::Sensor,    /*|*/ nullptr,    /*|*/ 1,  /*|*/ "time_secs", /*|*/  "time_ms"             )\
 PUEO_CONVERT_TYPE(/*|*/ daqhsk,    /*|*/  daq_hsk,        /*|*/ pueo::daqhsk::DaqHsk, /*|*/ nullptr,    /*|*/ 0,  /*|*/ "l2_readout_time", /*|*/  "l2_readout_timeNsecs"   )\
 PUEO_CONVERT_TYPE(/*|*/ timemark,  /*|*/  timemark,       /*|*/ pueo::Timemark,       /*|*/ nullptr,    /*|*/ 0,  /*|*/ "rising.fSec", /*|*/  "rising.fNanoSec"   )\
@@ -87,17 +97,64 @@ template <> inline int arity<pueo_sensors_disk_t> (const pueo_sensors_disk_t * d
 
 
 
+    /** What to optimize when tuning compression per branch (see ConvertOpts::compression_tuning) */
+    enum tuning_t
+    {
+      kNoTuning,       ///< use compression_algo / compression_level for everything
+      kSmallest,       ///< smallest output
+      kFastestDecode,  ///< fastest to read back
+      kBalanced        ///< smallest sum of size and decode time, each relative to the best candidate
+    };
+
+    /** How outputs are laid out on disk, see getLayout() */
+    enum layout_t
+    {
+      kDefaultLayout,  ///< ROOT's default clusters and baskets
+      kSequential,     ///< big clusters and baskets, for reading everything in order
+      kRandomAccess    ///< small clusters aligned to entries, for reading single entries (event display, playlists)
+    };
+
+    /** Cluster and basket sizes for a layout profile */
+    struct Layout
+    {
+      Long64_t auto_flush = 0; ///< as TTree::SetAutoFlush: > 0 is entries per cluster (so entry i is in cluster i / auto_flush), < 0 is bytes, 0 leaves ROOT's default
+      Int_t basket_size = 0;   ///< per branch, 0 leaves ROOT's default
+    };
+
+    /** The layout used for typetag with a profile. Events are much bigger than everything else, so they get their own. */
+    Layout getLayout(const char * typetag, layout_t profile);
+
+    /** Set up a tree (before filling) with the layout for typetag with a profile. Does nothing for kDefaultLayout. */
+    void applyLayout(TTree * t, const char * typetag, layout_t profile);
+
     struct ConvertOpts
     {
       bool clobber = false;
+      bool append = false; ///< add to an existing output only what's new: input files not in its manifest, and packets at the end of files that grew. The index is rebuilt. With sort_by, new entries are sorted among themselves and go after the existing ones, so if they belong before some of those, only the index is in order (there's a warning).
       const char * tmp_suffix = ".tmp";
       const char * postprocess_args = nullptr;
       const char * sort_by = nullptr;
       ROOT::RCompressionSetting::EAlgorithm::EValues compression_algo = ROOT::RCompressionSetting::EAlgorithm::kZSTD;
       int compression_level = 3;
+      tuning_t compression_tuning = kNoTuning; ///< benchmark candidate algorithm/level/basket size combinations per branch on the first tune_entries entries and pick by this objective. The choices are recorded in the output.
+      int tune_entries = 200;
+      const char * compression_from = nullptr; ///< comma-separated ROOT files whose recorded per-branch choices (from a tuned conversion) to reuse instead of tuning, for consistency across a campaign
+      layout_t layout = kDefaultLayout; ///< cluster and basket layout of the outputs. Tuned compression choices keep their own basket sizes.
+      int sort_buffer_mb = 256; ///< memory for decoded entries waiting to be sorted with sort_by. Input out of order by more than this is sorted in runs that are merged at the end.
+      const char * stats_file = nullptr; ///< where to write conversion statistics (rates, per-stage times, per-branch compression) as JSON. nullptr or "" means don't. In watch mode, it's rewritten by each update.
+      int nthreads = 1; ///< threads decoding input files (in parallel with writing), also used for ROOT's implicit MT when > 1. <= 0 means all hardware threads.
 
     };
 
+    /** One output of a conversion, for making several products in one read pass */
+    struct ConvertOutput
+    {
+      const char * typetag = nullptr;
+      const char * outfile = nullptr;
+      int decimate = 1; ///< only keep every decimate-th entry (in input order, continuing where the output left off when appending), e.g. for a decimated head file
+      const char * manifest_from = nullptr; ///< also skip inputs already converted into this file (e.g. the previous part of a rolled output)
+    };
+
    /** Convert input files to output file
      *
      * If typetag is NULL, empty or auto, the first packet from the first file will be read to determine the type. 
@@ -107,6 +164,10 @@ template <> inline int arity<pueo_sensors_disk_t> (const pueo_sensors_disk_t * d
      * We only allow one type per output file, not supporting heterogenous files
      * (that could be done, but in practice is not that useful given how we wrote out the data and the fact that there is no one-to-one mapping)
      *
+     * Several types made from the same raw type can be written in one pass over the input by giving comma-separated
+     * lists of typetags and output files, e.g. "header,event" and "headFile.root,eventFile.root". A typetag may have a
+     * ":N" suffix to only keep every Nth entry, e.g. "header:10" for a decimated head file.
+     *
      * @param typetag the type tag, you can use one of the helper constants under convert::typetags, or pass empty, 
      *         NULL or "auto" to try try to determine by itself, but this will work poorly in cases there is not a one-to-one mapping.
      *
@@ -114,11 +175,51 @@ template <> inline int arity<pueo_sensors_disk_t> (const pueo_sensors_disk_t * d
      * @param infiles  array of input files
      * @param outfile The output file
      *
+     * @return the number of entries converted (for the first output if there are several), or -1 on failure
      */
     int convertFiles(const char * typetag, int nfiles, const char ** infiles,  const char * outfile, const ConvertOpts & opts = ConvertOpts());
 
+    /** Convert input files to several outputs at once. Each input packet is read once and decoded for every output,
+     *  so all the typetags must share a raw type (e.g. header and event from full_waveforms). */
+    int convertFiles(int noutputs, const ConvertOutput * outputs, int nfiles, const char ** infiles, const ConvertOpts & opts = ConvertOpts());
+
     /** Similar to above, but an argument can be a directory instead of a file and in that case everything in the directory is added */
     int convertFilesOrDirectories(const char * typetag, int N, const char ** in,  const char * outfile, const ConvertOpts & opts = ConvertOpts());
+    int convertFilesOrDirectories(int noutputs, const ConvertOutput * outputs, int N, const char ** in, const ConvertOpts & opts = ConvertOpts());
+
+    /** Options for watchDirectories */
+    struct WatchOpts
+    {
+      const char * outdir = ".";   ///< outputs go in outdir/run<RUN>/, or outdir itself for inputs not under a run directory
+      int max_output_mb = 64;      ///< start a new part of an output once it's bigger than this. Each update copies the current part, so this bounds the I/O (and latency) of an update, at the cost of more parts for readers to chain.
+      double settle = 1;           ///< seconds without new files before converting what has arrived
+      int max_retries = 3;         ///< times to retry converting a file that failed (after each settle time) before giving up on it
+      const std::atomic<bool> * stop = nullptr; ///< set to stop watching (after converting whatever is pending)
+    };
+
+    /** Watch directories (and any created under them) with inotify, converting raw files once they're
+     * closed after writing or moved in. Files already there are converted at the start.
+     *
+     * Each output's outfile is a base name: the run is taken from a run<N> directory in the input path
+     * and outputs are written as outdir/run<N>/<base><N>.root, as pueo-convert-run does. Once an output is
+     * bigger than max_output_mb, the next part, <base><N>_1.root and so on, is started. Since every update
+     * rewrites the current part, each one costs at most about max_output_mb plus the new data, rather than
+     * growing with the run.
+     *
+     * Readers can open an output at any time: each update is converted into a copy of the current part,
+     * which is then renamed over it. Which inputs are already in a part, or an earlier part of the same run,
+     * is kept in the outputs' manifests (see ConvertOpts::append), so restarting picks up where it left off.
+     * If the inotify queue overflows, the directories are rescanned as at the start; files that fail to
+     * convert are retried up to max_retries times.
+     *
+     * @return the number of entries converted (for the first output), or -1 if anything failed
+     */
+    int watchDirectories(int noutputs, const ConvertOutput * outputs, int ndirs, const char ** dirs,
+                         const WatchOpts & wopts = WatchOpts(), const ConvertOpts & opts = ConvertOpts());
+
+    /** As above, with typetags and output base names as comma-separated lists, as for convertFiles */
+    int watchDirectories(const char * typetag, const char * outbase, int ndirs, const char ** dirs,
+                         const WatchOpts & wopts = WatchOpts(), const ConvertOpts & opts = ConvertOpts());
 
     namespace tags
     {
@@ -0,0 +1,126 @@
+/****************************************************************************************
+*  pueo/CorrelationCache.h              Per-event cache of channel cross-correlations
+*
+*  Only available if pueoEvent was built with FFTW (HAVE_FFTW).
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_CORRELATION_CACHE_H
+#define PUEO_CORRELATION_CACHE_H
+
+#include "Rtypes.h"
+#include "pueo/Conventions.h"
+
+#include <array>
+#include <vector>
+#include <complex>
+#include <utility>
+#include <unordered_map>
+
+namespace pueo
+{
+  class UsefulEvent;
+
+  //!  pueo::CorrelationCache -- channel spectra and pairwise cross-correlations for one event
+  /*!
+    Each channel is zero-padded to twice its length and FFT'd at most once per event. Each
+    requested pair's cross-spectrum is then inverse transformed (zero-padded in frequency by the
+    upsampling factor) at most once per event. The results are kept until the event changes, so
+    several consumers (sky maps, coherent sums, timing fits...) can share the work.
+
+    Correlations are normalized to correlation coefficients. For a pair (c1,c2), bin m of the correlation
+    compares sample k of c1 with sample k - m/U of c2 (negative m wrap around to the end), so its peak
+    is at the arrival time at c1 minus the arrival time at c2 (after accounting for the channels' t0).
+
+    The lazy getters (getSpectrum, getCorrelation) are not thread-safe. To share a cache between threads,
+    compute what's needed with prepare() first; the const accessors are then safe to call concurrently.
+
+    The event passed to setEvent must stay alive (and unchanged) while the cache is used with it.
+  */
+  class CorrelationCache
+  {
+    public:
+      typedef std::pair<Short_t,Short_t> ChanPair;
+
+      CorrelationCache(int upsample = 2);
+
+      /** Switch to an event. Does nothing if it's the same run and event number as the current one (unless force) */
+      void setEvent(const UsefulEvent & ev, bool force = false);
+
+      /** Forget everything (the memory is kept for reuse) */
+      void clear();
+
+      /** Compute any missing correlations for these pairs (and the spectra they need), spread over threads */
+      void prepare(const std::vector<ChanPair> & pairs, int nthreads = 1);
+
+      /** Compute any missing spectra for these channels, spread over threads */
+      void prepareSpectra(const std::vector<Short_t> & chans, int nthreads = 1);
+
+      /** Spectrum of a channel (getNFreq() values), computing it if needed */
+      const std::complex<double> * getSpectrum(size_t chan);
+
+      /** Correlation of a pair (getLength() values), computing it if needed */
+      const float * getCorrelation(size_t chan1, size_t chan2);
+
+      /** Correlation of a pair if it's already been computed, otherwise nullptr */
+      const float * findCorrelation(size_t chan1, size_t chan2) const;
+
+      /** Interpolated correlation of a pair at a time lag (ns), for either order of a computed pair (otherwise 0) */
+      double getCorrelationAt(size_t chan1, size_t chan2, double tau) const;
+
+      /** The lag (ns) of bin 0 and the lag step of bins of a pair's correlation */
+      double getLagOffset(size_t chan1, size_t chan2) const { return t0[chan1] - t0[chan2]; }
+      double getLagStep(size_t chan1, size_t chan2) const { return 0.5 * (dt[chan1] + dt[chan2]) / upsample; }
+
+      int getUpsample() const { return upsample; }
+      size_t getLength() const { return LU; }
+      size_t getNFreq() const { return nf; }
+      Int_t getRunNumber() const { return run; }
+      ULong_t getEventNumber() const { return eventNumber; }
+      size_t getNCorrelations() const { return index.size(); }
+
+    private:
+      CorrelationCache(const CorrelationCache &) = delete;
+      CorrelationCache & operator=(const CorrelationCache &) = delete;
+
+      void computeSpectrum(size_t chan);
+      void computeCorrelation(size_t chan1, size_t chan2, float * out);
+      float * allocCorrelation(size_t chan1, size_t chan2);
+
+      int upsample;
+      size_t L, LU, nf;
+
+      const UsefulEvent * ev = nullptr;
+      Int_t run = -1;
+      ULong_t eventNumber = 0;
+
+      std::array<std::vector<std::complex<double>>, k::NUM_RF_CHANNELS> spectra;
+      std::array<double, k::NUM_RF_CHANNELS> sumsq;
+      std::array<char, k::NUM_RF_CHANNELS> have_spectrum;
+      std::array<double, k::NUM_RF_CHANNELS> t0;
+      std::array<double, k::NUM_RF_CHANNELS> dt;
+
+      std::unordered_map<int, size_t> index; ///< chan1 * NUM_RF_CHANNELS + chan2 -> slot
+      std::vector<std::vector<float>> pool;  ///< slots, reused between events
+  };
+}
+
+#endif
@@ -15,6 +15,7 @@
 
 #include <vector>
 #include "pueo/Conventions.h"
+#include "pueo/CompactUsefulEvent.h"
 #include "TString.h"
 #include "TRandom3.h"
 
@@ -224,6 +225,12 @@ namespace pueo
        virtual UsefulEvent * useful(bool force_reload = false);
 
 
+      /** Loads the event in its compact form (see CompactUsefulEvent). This avoids
+       * the ~2 MB of doubles per UsefulEvent, so it is the one to use when holding
+       * many events in memory. If the event file already stores CompactUsefulEvents,
+       * it is returned as read, otherwise it is built with the given precision.  */
+      CompactUsefulEvent * compact(bool force_reload = false, CompactUsefulEvent::Precision precision = CompactUsefulEvent::kDerived);
+
       /** Loads the raw event. If force_reload is true, the event will be reloaded from the tree. */
       RawEvent * raw(bool force_reload = false);
 
@@ -258,6 +265,10 @@ namespace pueo
       bool IsL2PhiBitSet(int pol, int L2bit, bool override_test=false,UInt_t test=0);
       bool IsPolPhiTriggered(int pol, int phi, bool override_test=false, UInt_t test=0);
 
+      /** All 24 phi sectors at once (bit phi-1) for the current event. See pueo/TriggerBits.h for arrays of events. */
+      UInt_t getTriggeredPhis(int pol);
+      UInt_t getExcludedPhis(int pol);
+
       /* Wraps the random number generator for polarity inversion so it is derministic regardless of event processing order */
       bool maybeInvertPolarity(UInt_t eventNumber);
 
@@ -269,70 +280,6 @@ namespace pueo
 
       static int getRunAtTime(double t);
       static void setVerboseOutput(bool v);
-    private: 
-      static constexpr int phi_to_bits[25][2] = {
-        { -1, -1 }, // Index 0 (Unused placeholder)
-        {11, 0},    // phi 1  (Bit 11, Bit 0)
-        {11, 0},    // phi 2  (Bit 11, Bit 0)
-        {0, 1},     // phi 3  (Bit 0, Bit 1)
-        {0, 1},     // phi 4  (Bit 0, Bit 1)
-        {1, 2},     // phi 5  ...
-        {1, 2},     // phi 6
-        {2, 3},     // phi 7
-        {2, 3},     // phi 8
-        {3, 4},     // phi 9
-        {3, 4},     // phi 10
-        {4, 5},     // phi 11
-        {4, 5},     // phi 12
-        {5, 6},     // phi 13
-        {5, 6},     // phi 14
-        {6, 7},     // phi 15
-        {6, 7},     // phi 16
-        {7, 8},     // phi 17
-        {7, 8},     // phi 18
-        {8, 9},     // phi 19
-        {8, 9},     // phi 20
-        {9, 10},    // phi 21
-        {9, 10},    // phi 22
-        {10, 11},   // phi 23 (Bit 10, Bit 11)
-        {10, 11}    // phi 24 (Bit 10, Bit 11)
-      };
-
-
-    private: 
-      // Lookup table for Pol 0 (Phis 1-24 -> Local Bits 0-11)
-      static constexpr int pol0_to_bits[25][2] = {
-        { -1, -1 }, // Index 0 (Unused)
-        {5, 11}, {5, 11}, // phis 1, 2
-        {4, 5},  {4, 5},  // phis 3, 4
-        {3, 4},  {3, 4},  // phis 5, 6
-        {2, 3},  {2, 3},  // phis 7, 8
-        {1, 2},  {1, 2},  // phis 9, 10
-        {0, 1},  {0, 1},  // phis 11, 12
-        {6, 0},  {6, 0},  // phis 13, 14
-        {7, 6},  {7, 6},  // phis 15, 16
-        {8, 7},  {8, 7},  // phis 17, 18
-        {9, 8},  {9, 8},  // phis 19, 20
-        {10, 9}, {10, 9}, // phis 21, 22
-        {11, 10},{11, 10} // phis 23, 24
-      };
-      // Lookup table for Pol 1 (phis 1-24 -> Global Bits 12-23)
-      static constexpr int pol1_to_bits[25][2] = {
-        { -1, -1 },  // Index 0 (Unused)
-        {23, 17}, {23, 17}, // phis 1, 2
-        {22, 23}, {22, 23}, // phis 3, 4
-        {21, 22}, {21, 22}, // phis 5, 6
-        {20, 21}, {20, 21}, // phis 7, 8
-        {19, 20}, {19, 20}, // phis 9, 10
-        {18, 19}, {18, 19}, // phis 11, 12
-        {12, 18}, {12, 18}, // phis 13, 14
-        {13, 12}, {13, 12}, // phis 15, 16
-        {14, 13}, {14, 13}, // phis 17, 18
-        {15, 14}, {15, 14}, // phis 19, 20
-        {16, 15}, {16, 15}, // phis 21, 22
-        {17, 16}, {17, 16}  // phis 23, 24
-      };
-
     protected:
       void unloadRun();
       TTree * fHeadTree;
@@ -343,7 +290,9 @@ namespace pueo
       TTree *fEventTree;
       RawEvent * fRawEvent;
       UsefulEvent * fUsefulEvent;
+      CompactUsefulEvent * fCompactEvent;
       Bool_t fUsefulDirty;
+      Bool_t fCompactDirty;
       Bool_t fGpsDirty;  // used only with gpsFile data
       TTree* fGpsTree;
       nav::Attitude * fGps;
@@ -361,6 +310,7 @@ namespace pueo
       Bool_t fHaveGpsEvent;
       Bool_t fHaveDaqHskEvent;
       Bool_t fHaveUsefulFile;
+      Bool_t fHaveCompactFile;
       std::vector<TFile *> filesToClose;
       bool fDecimated;
       TEventList * fCutList;
@@ -386,6 +336,7 @@ namespace pueo
       Int_t needToOverwriteEvent(pol::pol_t pol, UInt_t eventNumber);
       void overwriteHeader(RawHeader* header, pol::pol_t pol, Int_t fakeTreeEntry);
       void overwriteEvent(UsefulEvent* useful, pol::pol_t pol, Int_t fakeTreeEntry);
+      void overwriteCompact(CompactUsefulEvent* compact);
 
       // fake things
       TFile* fBlindFile; ///!< Pointer to file containing tree of UsefulAnitaEvents to insert
@@ -0,0 +1,75 @@
+/****************************************************************************************
+*  pueo/EventGraphs.h              Reusable per-channel graphs for event displays
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_EVENT_GRAPHS_H
+#define PUEO_EVENT_GRAPHS_H
+
+#include "Rtypes.h"
+#include "pueo/Conventions.h"
+#include <array>
+
+class TGraph;
+
+namespace pueo
+{
+  class UsefulEvent;
+
+  //!  pueo::EventGraphs -- one preallocated TGraph per channel
+  /*!
+    Meant for event displays that redraw every channel for every event. The graphs
+    (and their names, titles and axis labels) are made once, and update() just copies
+    the new waveforms in, so nothing is allocated or leaked per event.
+
+    The graphs are owned by this object, so don't delete them (or let a TList own them).
+    After an update, mark the pads as modified to redraw.
+  */
+  class EventGraphs
+  {
+    public:
+      EventGraphs();
+      ~EventGraphs();
+
+      /** Refresh all channels from an event */
+      void update(const UsefulEvent & ev);
+
+      /** Refresh a single channel */
+      void update(const UsefulEvent & ev, size_t chanIndex);
+
+      TGraph * get(size_t chanIndex) const { return chanIndex < graphs.size() ? graphs[chanIndex] : nullptr; }
+      TGraph * get(int ant, pol::pol_t pol) const;
+      TGraph * get(ring::ring_t ring, int phi, pol::pol_t pol) const;
+      TGraph * get(int surf, int chan) const;
+
+      /** The event number of the last update */
+      ULong_t getEventNumber() const { return eventNumber; }
+
+    private:
+      EventGraphs(const EventGraphs &) = delete;
+      EventGraphs & operator=(const EventGraphs &) = delete;
+
+      std::array<TGraph*, k::NUM_RF_CHANNELS> graphs;
+      ULong_t eventNumber = 0;
+  };
+}
+
+#endif
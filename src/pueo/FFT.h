@@ -0,0 +1,74 @@
+/****************************************************************************************
+*  pueo/FFT.h              Real FFTs with cached FFTW plans
+*
+*  Only available if pueoEvent was built with FFTW (HAVE_FFTW).
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_FFT_H
+#define PUEO_FFT_H
+
+#include "pueo/Conventions.h"
+#include <complex>
+#include <cstddef>
+
+namespace pueo
+{
+
+  //!  pueo::FFT -- real-to-complex transforms of a fixed length
+  /*!
+    There is one FFT per length, created on first use and kept for the life of the program.
+    Plans are made once (under a lock, since FFTW planning isn't thread-safe), and
+    executed on per-thread aligned scratch buffers, so all the methods may be called
+    concurrently from any number of threads.
+  */
+  class FFT
+  {
+    public:
+      /** The (shared) transform of length N */
+      static const FFT & get(size_t N = k::NUM_SAMPLES);
+
+      size_t size() const { return N; }
+      size_t nfreq() const { return N/2+1; }
+
+      /** out (nfreq() values) = unnormalized DFT of in (size() values) */
+      void forward(const double * in, std::complex<double> * out) const;
+
+      /** out (size() values) = inverse DFT of in (nfreq() values), normalized so that inverse(forward(x)) = x */
+      void inverse(const std::complex<double> * in, double * out) const;
+
+      /** One-sided power spectral density of in (size() values, sampled every dt).
+       *  psd has nfreq() values, in units of in^2 / (1/dt) (so mV^2/GHz for mV and ns),
+       *  normalized so that the sum of psd * df is the mean square of in. */
+      void power(const double * in, double * psd, double dt) const;
+
+    private:
+      FFT(size_t N);
+      FFT(const FFT &) = delete;
+      FFT & operator=(const FFT &) = delete;
+
+      size_t N;
+      void * fwd_plan;
+      void * inv_plan;
+  };
+}
+
+#endif
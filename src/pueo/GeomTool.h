@@ -38,6 +38,8 @@
 #include <fstream>
 #include <cstring>
 #include <string>
+#include <array>
+#include <vector>
 
 #include "TString.h"
 #include "TObjArray.h"
@@ -89,8 +91,15 @@ namespace  pueo
      */
     static const GeomTool & Instance( Int_t pueo_version = 0, const char * geometry_source = "" );
 
+    /** 
+     * Resolve a version and geometry source (same meaning as for Instance) to its instance once. 
+     * Instances are never deleted, so the pointer may be kept and used from any thread. Hot loops 
+     * that use a particular geometry should resolve it once and use the pointer. 
+     */
+    static const GeomTool * getHandle( Int_t pueo_version = 0, const char * geometry_source = "" );
+
     static void setDefaultGeometry(Int_t pueo_version, const std::string & default_source); 
-    static const std::string & getDefaultGeometry(Int_t pueo_version = 0); 
+    static std::string getDefaultGeometry(Int_t pueo_version = 0); 
 
 
     /** Get Ring from antenna index */ 
@@ -135,6 +144,11 @@ namespace  pueo
 
     Int_t getAntFromPhiRing(Int_t phi, pueo::ring::ring_t ring) const; ///< get antenna number from phi and ring
 
+    /** For each channel index of this geometry, the index into RawEvent::data (i.e. the flight geometry channel
+     * index) it is read out on, or -1 if there is none. Built once per geometry and cached, so this is what
+     * per-event loops should use. */
+    const std::array<Short_t, k::NUM_RF_CHANNELS> & getDataChanMap() const;
+
     Int_t getAntOrientation(Int_t ant) const; ///< Some of the antennas have their orientation reversed relative to nominal. The effect of this is to switch the sign the of the signal (as up is down and left is right). Returns 1 for nominal orientation and -1 for flipped.
 
     static Double_t getPhiDiff(Double_t firstPhi, Double_t secondPhi); 
@@ -144,6 +158,9 @@ namespace  pueo
     ********************************************************************************************************/
     Double_t getDirectionWrtNorth(Int_t phi, Double_t heading) const; ///< Get direction that a phi sector is pointing wrt north.  Also takes heading as a input.
 
+    /** Batch version of getDirectionWrtNorth, for n phi sectors and headings */ 
+    void getDirectionWrtNorth(const Int_t * phi, const Double_t * heading, size_t n, Double_t * direction) const; 
+
     void getAntXYZ(Int_t ant, Double_t &x, Double_t &y, Double_t &z,
        pueo::pol::pol_t pol=pueo::pol::kVertical) const; ///< get antenna cartesian coordinates (from photogrammetry)
 
@@ -160,6 +177,9 @@ namespace  pueo
     Int_t getTopAntNearestPhiWave(Double_t phiWave, pol::pol_t=pol::kVertical) const; ///< get antenna closest to given plane wave direction
 
     Int_t getUpperAntNearestPhiWave(Double_t phiWave, pol::pol_t pol=pol::kVertical) const;
+
+    /** Batch version of getTopAntNearestPhiWave, for n plane-wave directions */ 
+    void getTopAntNearestPhiWave(const Double_t * phiWave, size_t n, Int_t * ant, pol::pol_t pol=pol::kVertical) const; 
     
     void getAntFaceXYZ(Int_t ant, Double_t &x, Double_t &y, Double_t &z) const; ///< get location fo antenna face in balloon cartesian coordinates
 
@@ -175,6 +195,14 @@ namespace  pueo
 
     Int_t getUpperAntFaceNearestPhiWave(Double_t phiWave)  const{ return getTopAntFaceNearestPhiWave(phiWave);}///< get upper antenna closest to given plane wave direction
 
+    /** Batch version of getTopAntFaceNearestPhiWave, for n plane-wave directions */ 
+    void getTopAntFaceNearestPhiWave(const Double_t * phiWave, size_t n, Int_t * ant) const; 
+
+    Int_t getPhiSectorNearestPhiWave(Double_t phiWave) const; ///< phi sector of the top antenna face closest to given plane wave direction 
+
+    /** Batch version of getPhiSectorNearestPhiWave, for n plane-wave directions */ 
+    void getPhiSectorNearestPhiWave(const Double_t * phiWave, size_t n, Int_t * phi) const; 
+
     double aftForeOffsetAngleVertical; 
     TVector3 fHeadingRotationAxis;
     TVector3 fPitchRotationAxis;
@@ -219,6 +247,12 @@ namespace  pueo
     static void getLatLonAltFromCartesian(Double_t p[3], Double_t &lat, Double_t &lon, Double_t &alt);
     static Double_t getDistanceToCentreOfEarth(Double_t lat);
 
+    /** Batch versions of getCartesianCoords and getLatLonAltFromCartesian, with the same conventions.
+     * p holds n points as p[3*i + xyz]. The inverse is Vermeille's (2002) closed form, so there is no
+     * iteration and it is accurate to well under a mm near the surface. */ 
+    static void getCartesianCoords(const Double_t * lat, const Double_t * lon, const Double_t * alt, size_t n, Double_t * p);
+    static void getLatLonAltFromCartesian(const Double_t * p, size_t n, Double_t * lat, Double_t * lon, Double_t * alt);
+
 
 
 
@@ -228,6 +262,45 @@ namespace  pueo
     bool readPositions(int v, const std::string &src);
     pueo::data::GeometryReader r; 
 
+    void buildTables(); 
+
+    /** Everything the reader knows about a channel, by channel index */ 
+    struct ChanInfo 
+    {
+      Short_t surf = -1; 
+      Short_t chan = -1; 
+      Short_t ant = -1; 
+      Char_t pol = pol::kNotAPol; 
+      Char_t ring = ring::kNotARing; 
+      Char_t phi = -1; 
+    }; 
+
+    /** nullptr if the reader doesn't know the channel. Digitized channels without an antenna have ant < 0. */ 
+    const ChanInfo * info(Int_t chanIndex) const 
+    {
+      return chanIndex >= 0 && chanIndex < k::NUM_DIGITIZED_CHANNELS && chanInfo[chanIndex].surf >= 0 ? &chanInfo[chanIndex] : nullptr; 
+    }
+
+    static constexpr int MAX_SURF = k::NUM_SURF_SLOTS + 1; // in case surfs are numbered from 1 
+
+    // dense tables filled by buildTables(), so that lookups are a bounds check and a load 
+    std::array<ChanInfo, k::NUM_DIGITIZED_CHANNELS> chanInfo; 
+    std::array<Short_t, MAX_SURF * k::NUM_CHANS_PER_SURF> chanFromSurfChan; 
+    std::array<std::array<Short_t, k::NUM_POLS>, k::NUM_ANTS> chanFromAntPol; 
+    std::array<std::array<std::array<Short_t, k::NUM_POLS>, ring::kNotARing>, k::NUM_PHI+1> chanFromPhiRingPol; // phi may be 0 or 1 based 
+    std::array<std::array<std::array<double,3>, k::NUM_POLS>, k::NUM_ANTS> antPhaseCenter; 
+    std::array<std::array<double, k::NUM_POLS>, k::NUM_ANTS> antPhasePhi; 
+
+    /** Top-ring antenna azimuths (payload frame, [0,2pi)) sorted, for nearest-antenna lookups */ 
+    struct AzTable 
+    {
+      std::vector<double> az; 
+      std::vector<Short_t> ant; 
+      int nearest(double phi) const; ///< index of the entry nearest to phi (in [0,2pi)), going around the circle 
+    }; 
+    std::array<AzTable, k::NUM_POLS> topPhaseAz; 
+    AzTable topFaceAz; 
+
 
   };
 
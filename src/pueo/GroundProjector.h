@@ -0,0 +1,175 @@
+/****************************************************************************************
+*  pueo/GroundProjector.h              Projecting payload-frame directions onto the ground
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_GROUND_PROJECTOR_H
+#define PUEO_GROUND_PROJECTOR_H
+
+#include "Rtypes.h"
+#include "pueo/NavRotation.h"
+#include <array>
+#include <vector>
+#include <list>
+#include <memory>
+#include <string>
+#include <functional>
+
+namespace pueo
+{
+  class GeomTool;
+
+  /** Height of the surface above the WGS84 ellipsoid (m) at a geodetic latitude and longitude (degrees, signed).
+   * Implementations must be safe to call from several threads at once. */
+  class ElevationModel
+  {
+    public:
+      virtual ~ElevationModel() { ; }
+      virtual double getElevation(double lat, double lon) const = 0;
+  };
+
+
+  /** The same elevation everywhere (e.g. 0 for the bare ellipsoid) */
+  class ConstantElevation : public ElevationModel
+  {
+    public:
+      ConstantElevation(double h = 0) : height(h) { ; }
+      virtual double getElevation(double, double) const { return height; }
+    private:
+      double height;
+  };
+
+
+  //!  pueo::TiledElevation -- an elevation model made of lat/lon tiles loaded on demand
+  /*!
+    The surface is split into tile_deg x tile_deg degree tiles, named by the (floored)
+    latitude and longitude of their south-west corner. Tiles are loaded the first time
+    they're needed and kept in a least-recently-used cache, so projecting many events
+    over the same area only touches the disk once per tile. Within a tile the elevation
+    is bilinearly interpolated between bin centres. Points outside the outer bin centres
+    use the edge values. Missing tiles count as 0 (the ellipsoid).
+
+    By default tiles are read from ROOT files <dir>/elev_<lat>_<lon>.root. Each file holds a TH2
+    called "elevation", with x = longitude and y = latitude (degrees) and contents in m.
+    The default dir is $PUEO_ELEVATION_DIR. Pass a loader to read from somewhere else.
+  */
+  class TiledElevation : public ElevationModel
+  {
+    public:
+      struct Tile
+      {
+        int nlon = 0, nlat = 0;
+        double lon0 = 0, lat0 = 0;   ///< first bin centre
+        double dlon = 1, dlat = 1;   ///< bin widths
+        std::vector<float> h;        ///< indexed by ilat * nlon + ilon
+        double at(double lat, double lon) const;
+      };
+
+      /** Fill the tile whose south-west corner is (lat,lon) in integer degrees. Returns false if there is none. */
+      typedef std::function<bool(int lat, int lon, Tile & tile)> Loader;
+
+      TiledElevation(const std::string & dir = "", int tile_deg = 1, size_t cache_size = 64);
+      TiledElevation(Loader loader, int tile_deg = 1, size_t cache_size = 64);
+
+      virtual double getElevation(double lat, double lon) const;
+
+      /** Loader reading elev_<lat>_<lon>.root from dir */
+      static Loader rootFileLoader(const std::string & dir);
+
+      size_t getNLoaded() const { return nloaded; }
+
+    private:
+      std::shared_ptr<const Tile> getTile(int ilat, int ilon) const;
+
+      Loader loader;
+      int tile_deg;
+      size_t cache_size;
+      ULong64_t id;
+      mutable size_t nloaded = 0;
+      mutable std::list<std::pair<Long64_t, std::shared_ptr<const Tile>>> cache; ///< most recently used at the front
+  };
+
+
+  /** Where a direction hits the ground */
+  struct GroundPoint
+  {
+    double lat = 0;       ///< degrees
+    double lon = 0;       ///< degrees
+    double alt = 0;       ///< m above the ellipsoid
+    double distance = -1; ///< m from the payload along the ray
+    bool ok = false;      ///< false if the direction doesn't reach the ground
+  };
+
+
+  //!  pueo::GroundProjector -- intersects payload-frame directions with an ellipsoid-plus-elevation surface
+  /*!
+    Directions are given as in SkyMapConfig: phi is the payload azimuth (degrees from
+    +x towards +y) and theta the elevation (degrees, positive up), so directions that hit
+    the ground have negative theta. The payload +x axis points at heading plus
+    GeomTool::aftForeOffsetAngleVertical, measured clockwise from north, which is the
+    same convention as GeomTool::getDirectionWrtNorth. Positive pitch raises +x and
+    positive roll raises +y.
+
+    The payload-to-Earth rotation and the payload's Earth-centred position are
+    computed once per attitude sample by setAttitudes() (in a nav::RotationCache,
+    which also interpolates them to event times). Projecting is then a
+    rotation plus a few ray/ellipsoid intersections for each direction. The
+    ellipsoid is raised or lowered each time until its height at the hit matches
+    the elevation model.
+  */
+  class GroundProjector
+  {
+    public:
+      /** model defaults to the bare ellipsoid, geom to the default geometry */
+      GroundProjector(std::shared_ptr<const ElevationModel> model = nullptr, const GeomTool * geom = nullptr);
+
+      /** Precompute the frame of each attitude sample (see nav::RotationCache) */
+      void setAttitudes(const std::vector<nav::Attitude> & att);
+      void setAttitudes(const nav::Attitude * att, size_t n);
+      size_t getNAttitudes() const { return frames.size(); }
+
+      /** Project n directions seen from attitude sample iatt. Returns the number that hit the ground. */
+      size_t project(size_t iatt, size_t n, const double * phi, const double * theta, GroundPoint * out, int nthreads = 1) const;
+
+      /** Project n directions, the i-th seen from attitude sample iatt[i]. Returns the number that hit the ground. */
+      size_t project(size_t n, const size_t * iatt, const double * phi, const double * theta, GroundPoint * out, int nthreads = 1) const;
+
+      /** Project n directions seen at time t (unix seconds), interpolating between attitude samples. Returns the number that hit the ground. */
+      size_t projectAt(double t, size_t n, const double * phi, const double * theta, GroundPoint * out, int nthreads = 1) const;
+
+      /** Project n directions, the i-th seen at time t[i]. Returns the number that hit the ground. */
+      size_t projectAt(size_t n, const double * t, const double * phi, const double * theta, GroundPoint * out, int nthreads = 1) const;
+
+      /** One-off projection from an attitude that wasn't set up front */
+      bool project(const nav::Attitude & att, double phi, double theta, GroundPoint & out) const;
+
+      const ElevationModel & getElevationModel() const { return *model; }
+      const nav::RotationCache & getRotations() const { return frames; }
+
+    private:
+      bool intersect(const nav::AttitudeFrame & f, double phi, double theta, GroundPoint & out) const;
+
+      std::shared_ptr<const ElevationModel> model;
+      nav::RotationCache frames;
+  };
+}
+
+#endif
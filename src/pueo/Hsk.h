@@ -27,6 +27,9 @@
 #define PUEO_HSK_H
 
 #include "Rtypes.h"
+#include <string>
+#include <vector>
+class TDirectory;
 #ifdef HAVE_PUEORAWDATA
 #include "pueo/rawdata.h"
 #endif
@@ -66,6 +69,88 @@ public:
   char kind_unit;
   ClassDefNV(Sensor,3);
 };
+
+
+// What a sensor is. Stored once per sensor rather than with every reading.
+class SensorInfo
+{
+public:
+  UShort_t sensor_id=0;
+  std::string subsys;
+  std::string name;
+  char typetag=0;    ///< how the value is encoded: 'I' (signed), 'U' (unsigned), otherwise float
+  char kind_unit=0;
+  ClassDefNV(SensorInfo,1);
+};
+
+
+// A compact reading: just the sensor, time and decoded value. The rest is in the SensorTable.
+class Reading
+{
+public:
+  Reading() {;}
+#ifdef HAVE_PUEORAWDATA
+  Reading(const pueo_sensors_disk_t *hsk,int whichsensor):
+    sensor_id(hsk->sensors[whichsensor].sensor_id < PUEO_MAX_SENSORS ? hsk->sensors[whichsensor].sensor_id : throw "sensor out range"),
+    time_ms(hsk->sensors[whichsensor].time_ms),
+    time_secs(hsk->sensors[whichsensor].time_secs),
+    value(decode(pueo_sensor_id_get_type_tag(hsk->sensors[whichsensor].sensor_id),
+                 hsk->sensors[whichsensor].val.fval, hsk->sensors[whichsensor].val.ival, hsk->sensors[whichsensor].val.uval)){;}
+#endif
+  UShort_t sensor_id=0;
+  UShort_t time_ms=0;
+  UInt_t time_secs=0;
+  Double_t value=0; ///< as the sensor's type says (exact for all of them)
+
+  Double_t getTime() const { return time_secs + 1e-3 * time_ms; }
+
+  /** The value as the old-style Sensor would have had it (which_sensor, the position in the packet, isn't kept) */
+  Sensor toSensor(const SensorInfo & info) const;
+
+  static Double_t decode(char typetag, Float_t fval, Int_t ival, UInt_t uval)
+  {
+    return typetag == 'I' || typetag == 'i' ? Double_t(ival) : typetag == 'U' || typetag == 'u' ? Double_t(uval) : Double_t(fval);
+  }
+
+  ClassDefNV(Reading,1);
+};
+
+
+//!  pueo::hsk::SensorTable -- the sensor metadata that goes with Readings
+/*!
+  Indexed by sensor id. The converter writes it next to the readings as a
+  tree called hskSensorTree, with one SensorInfo per known sensor.
+*/
+class SensorTable
+{
+public:
+  static constexpr const char * tree_name = "hskSensorTree";
+
+  /** Reads the table from a directory (e.g. a converted file). Returns false if there isn't one. */
+  bool read(TDirectory * d);
+  void write(TDirectory * d) const;
+
+  /** nullptr if the sensor isn't known */
+  const SensorInfo * get(UShort_t sensor_id) const;
+
+  /** By name, or subsys/name if the name alone is ambiguous. nullptr if there's no such sensor. */
+  const SensorInfo * find(const char * name) const;
+
+  void add(const SensorInfo & info);
+  size_t size() const { return nknown; }
+
+  /** Rebuilds the old-style Sensor for a reading */
+  Sensor sensor(const Reading & r) const;
+
+#ifdef HAVE_PUEORAWDATA
+  /** Every sensor libpueorawdata knows about */
+  static SensorTable fromRawData();
+#endif
+
+private:
+  std::vector<SensorInfo> sensors; ///< indexed by id, empty names are unknown
+  size_t nknown = 0;
+};
 }
 }
 
@@ -0,0 +1,131 @@
+/****************************************************************************************
+*  pueo/HskSeries.h              Per-sensor queries on housekeeping data
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_HSK_SERIES_H
+#define PUEO_HSK_SERIES_H
+
+#include "Rtypes.h"
+#include "pueo/Hsk.h"
+#include <vector>
+#include <map>
+#include <memory>
+
+class TFile;
+class TTree;
+
+namespace pueo
+{
+  namespace hsk
+  {
+    /** One reading of a sensor */
+    struct Point
+    {
+      Double_t t = 0;     ///< unix seconds
+      Double_t value = 0;
+    };
+
+    /** Readings of a sensor within [t0, t1) */
+    struct EnvelopeBin
+    {
+      Double_t t0 = 0, t1 = 0;
+      Double_t min = 0, max = 0; ///< 0 if n is 0
+      UInt_t n = 0;
+    };
+
+
+    //!  pueo::hsk::SeriesReader -- time-series queries for single sensors
+    /*!
+      Reads an hskseriesTree (see SensorTable), or an old-style hskTree of
+      Sensors. Each sensor's readings are loaded the first time they're
+      asked for and then kept, sorted by time, so later queries are binary
+      searches.
+
+      With the (sensor_id, time) index the converter builds for
+      hskseriesTree, loading a sensor only reads that sensor's values. Files
+      without it (including every hskTree) are read once, in one pass, the
+      first time anything is asked for.
+
+      Envelopes use the min and max of blocks of readings, so plotting months
+      of a sensor only looks at each reading once, when it's loaded.
+
+      Not thread safe.
+    */
+    class SeriesReader
+    {
+      public:
+        /** A file with an hskseriesTree (and hskSensorTree), or an hskTree */
+        SeriesReader(const char * file);
+
+        /** A tree already open. table is needed for lookups by name if tree is an hskseriesTree. */
+        SeriesReader(TTree * tree, const SensorTable * table = nullptr);
+        ~SeriesReader();
+
+        bool ok() const { return tree != nullptr; }
+        const SensorTable & getSensors();
+
+        /** Readings of a sensor with t0 <= t <= t1, in time order. Returns how many. */
+        size_t series(UShort_t sensor_id, double t0, double t1, std::vector<Point> & out);
+        size_t series(const char * name, double t0, double t1, std::vector<Point> & out);
+
+        /** The last reading at or before t. Returns false if there's none. */
+        bool valueAt(UShort_t sensor_id, double t, Point & out);
+        bool valueAt(const char * name, double t, Point & out);
+
+        /** The min and max of a sensor in nbins equal bins over [t0, t1). Returns the number of readings in [t0, t1). */
+        size_t envelope(UShort_t sensor_id, double t0, double t1, int nbins, std::vector<EnvelopeBin> & out);
+        size_t envelope(const char * name, double t0, double t1, int nbins, std::vector<EnvelopeBin> & out);
+
+        /** Number of readings of a sensor (loading it) */
+        size_t size(UShort_t sensor_id);
+
+        /** Loads every sensor now, in one pass, rather than one by one when first used */
+        void loadAll();
+
+      private:
+        struct Series
+        {
+          std::vector<Double_t> t;
+          std::vector<Double_t> v;
+          std::vector<Double_t> block_min, block_max;
+        };
+
+        static const size_t block_size = 256;
+
+        const Series * get(UShort_t sensor_id);
+        int resolve(const char * name);
+        void load(UShort_t sensor_id, Series & s);
+        void scan();
+        static void finish(Series & s);
+
+        std::unique_ptr<TFile> file;
+        TTree * tree = nullptr;
+        bool compact = false;  ///< hskseriesTree rather than hskTree
+        bool indexed = false;  ///< has the converter's (sensor_id, time) index
+        bool scanned = false;
+        SensorTable sensors;
+        std::map<UShort_t, Series> cache;
+    };
+  }
+}
+
+#endif
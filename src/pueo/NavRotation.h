@@ -0,0 +1,131 @@
+/****************************************************************************************
+*  pueo/NavRotation.h              Cached payload <-> Earth rotations from attitude samples
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_NAV_ROTATION_H
+#define PUEO_NAV_ROTATION_H
+
+#include "Rtypes.h"
+#include <array>
+#include <vector>
+#include <cstddef>
+
+namespace pueo
+{
+  class GeomTool;
+
+  namespace nav
+  {
+    class Attitude;
+
+    /** A unit quaternion, for rotations that interpolate nicely */
+    struct Quaternion
+    {
+      double w = 1, x = 0, y = 0, z = 0;
+
+      static Quaternion fromAxisAngle(double ax, double ay, double az, double angle);
+      static Quaternion slerp(const Quaternion & a, const Quaternion & b, double f);
+
+      Quaternion operator*(const Quaternion & o) const;
+      Quaternion conjugate() const { Quaternion q; q.w = w; q.x = -x; q.y = -y; q.z = -z; return q; }
+
+      /** The equivalent rotation matrix, row major */
+      void toMatrix(double m[9]) const;
+    };
+
+    /** The frames directions can be transformed between */
+    enum frame_t
+    {
+      kPayload, ///< x along the payload's phi = 0, z up the payload axis (as TruthEvent::payloadPhi/payloadTheta)
+      kLocal,   ///< east, north, up at the payload
+      kEarth    ///< Earth-centred, Earth-fixed (WGS84, not GeomTool's swapped convention)
+    };
+
+    /** Everything needed to turn payload directions into Earth ones at one time */
+    struct AttitudeFrame
+    {
+      double time = 0;             ///< unix time (s)
+      double latitude = 0;         ///< degrees
+      double longitude = 0;        ///< degrees
+      double altitude = 0;         ///< m
+      std::array<double,3> ecef = {{0,0,0}};  ///< position, m
+      Quaternion toLocal;          ///< payload -> kLocal
+      Quaternion toEarth;          ///< payload -> kEarth
+      std::array<double,9> localMatrix;  ///< toLocal as a row-major matrix
+      std::array<double,9> earthMatrix;  ///< toEarth as a row-major matrix
+
+      /** Transform n directions (in[3*i + xyz]) between frames. in and out may be the same. */
+      void transform(frame_t from, frame_t to, size_t n, const double * in, double * out) const;
+
+      /** Fill the matrices from the quaternions */
+      void updateMatrices();
+    };
+
+    /** Payload angles (degrees; phi from +x towards +y, theta the elevation, positive up) to unit vectors and back */
+    void anglesToVectors(size_t n, const double * phi, const double * theta, double * v);
+    void vectorsToAngles(size_t n, const double * v, double * phi, double * theta);
+
+
+    //!  pueo::nav::RotationCache -- payload <-> Earth rotations for a set of attitude samples
+    /*!
+      The rotations are built once per sample, from heading (of the aft-fore line,
+      offset by GeomTool::aftForeOffsetAngleVertical), pitch (positive raises +x) and
+      roll (positive raises +y), together with the sample's position. Frames at event
+      times are interpolated between the neighbouring samples: slerp for the rotations
+      and linear for the position. Times outside the samples use the nearest one.
+    */
+    class RotationCache
+    {
+      public:
+        /** geom is used for the aft-fore offset, defaulting to the default geometry */
+        RotationCache(const GeomTool * geom = nullptr);
+
+        void set(const Attitude * att, size_t n);
+        void set(const std::vector<Attitude> & att);
+        void clear() { frames.clear(); order.clear(); times.clear(); }
+
+        size_t size() const { return frames.size(); }
+
+        /** The frame of sample i (in the order given to set) */
+        const AttitudeFrame & get(size_t i) const { return frames[i]; }
+
+        /** The frame at time t (unix seconds). Returns false if there are no samples. */
+        bool at(double t, AttitudeFrame & f) const;
+
+        /** Frames at n times. Returns how many could be filled (0 or n). */
+        size_t at(const double * t, size_t n, AttitudeFrame * out) const;
+
+        /** The frame for one attitude, without caching it */
+        AttitudeFrame makeFrame(const Attitude & att) const;
+
+        static double getTime(const Attitude & att);
+
+      private:
+        double aft_fore_offset;
+        std::vector<AttitudeFrame> frames;
+        std::vector<size_t> order;   ///< indices into frames, in time order
+        std::vector<double> times;   ///< parallel to order
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,142 @@
+/****************************************************************************************
+*  pueo/SkyMap.h              Interferometric sky maps
+*
+*  Only available if pueoEvent was built with FFTW (HAVE_FFTW).
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_SKYMAP_H
+#define PUEO_SKYMAP_H
+
+#include "Rtypes.h"
+#include "pueo/Conventions.h"
+#include <vector>
+#include <utility>
+
+class TH2D;
+
+namespace pueo
+{
+  class UsefulEvent;
+  class GeomTool;
+  class CorrelationCache;
+
+  /** The grid and antenna selection for a sky map. Angles are in degrees, in payload coordinates:
+   * phi is the azimuth (from +x towards +y) and theta the elevation (positive is up). */
+  struct SkyMapConfig
+  {
+    int nphi = 360;
+    double phi_min = 0;
+    double phi_max = 360;
+    int ntheta = 90;
+    double theta_min = -60;
+    double theta_max = 30;
+
+    double max_phi_offset = 45; ///< only use an antenna for directions within this of its azimuth
+    int upsample = 2;           ///< correlation upsampling factor
+    bool include_lf = false;    ///< also use the low-frequency antennas
+  };
+
+
+  //!  pueo::SkyMap -- the result of mapping one event
+  class SkyMap
+  {
+    public:
+      SkyMap(const SkyMapConfig & cfg = SkyMapConfig()) { reset(cfg); }
+
+      /** Resize to cfg's grid and zero */
+      void reset(const SkyMapConfig & cfg);
+
+      int nphi, ntheta;
+      double phi_min, phi_max, theta_min, theta_max;
+      pol::pol_t pol = pol::kVertical;
+      ULong_t eventNumber = 0;
+
+      /** Average normalized correlation, indexed by itheta * nphi + iphi */
+      std::vector<float> values;
+
+      float at(int itheta, int iphi) const { return values[itheta * nphi + iphi]; }
+      double phi(int iphi) const { return phi_min + (iphi + 0.5) * (phi_max - phi_min) / nphi; }
+      double theta(int itheta) const { return theta_min + (itheta + 0.5) * (theta_max - theta_min) / ntheta; }
+
+      /** Location (bin centre) and value of the maximum */
+      void findPeak(double & theta, double & phi, double & value) const;
+
+      /** Make a histogram (x = phi, y = theta). Caller owns it. */
+      TH2D * makeHist(const char * name = "skymap") const;
+  };
+
+
+  //!  pueo::SkyMapper -- builds sky maps from cross-correlations of antenna pairs
+  /*!
+    All the geometry is done once when this is constructed: the antenna pairs that
+    can see each direction and the expected delay of each pair at each grid point
+    are tabulated for the given geometry, polarization and grid. Mapping an event
+    is then a correlation per pair (from a CorrelationCache, so they can be shared with
+    other consumers) plus a table walk, spread over threads by row of the map.
+
+    A plane wave from direction n reaches an antenna at r at time -r.n/c, so the
+    table holds (r_j - r_i).n / c for each pair (i,j).
+
+    Construct one per geometry/pol/grid and reuse it for every event.
+  */
+  class SkyMapper
+  {
+    public:
+      SkyMapper(pol::pol_t pol, const SkyMapConfig & cfg = SkyMapConfig());
+      SkyMapper(pol::pol_t pol, const SkyMapConfig & cfg, const GeomTool & geom);
+
+      /** Map an event. nthreads <= 0 means all hardware threads. */
+      void compute(const UsefulEvent & ev, SkyMap & map, int nthreads = 1) const;
+
+      /** Map the cache's current event, computing (and leaving in the cache) whichever pair correlations are missing */
+      void compute(CorrelationCache & cache, SkyMap & map, int nthreads = 1) const;
+
+      /** The channel pairs used, e.g. to prepare a shared cache */
+      const std::vector<std::pair<Short_t,Short_t>> & getChannelPairs() const { return chan_pairs; }
+
+      const SkyMapConfig & getConfig() const { return cfg; }
+      pol::pol_t getPol() const { return pol; }
+      size_t getNPairs() const { return pairs.size(); }
+      size_t getTableSize() const { return delays.size(); }
+
+    private:
+      void init(const GeomTool & geom);
+
+      typedef std::pair<Short_t,Short_t> ChanPair;
+
+      struct Pair
+      {
+        int iphi0, nphi; ///< azimuth bins this pair is used for (wrapping modulo the grid)
+        size_t offset;   ///< into delays, as [itheta][k] for k < nphi
+      };
+
+      pol::pol_t pol;
+      SkyMapConfig cfg;
+      std::vector<Short_t> chans;  ///< channel indices used
+      std::vector<Pair> pairs;
+      std::vector<ChanPair> chan_pairs; ///< parallel to pairs
+      std::vector<float> delays;   ///< ns
+      std::vector<float> norm;     ///< 1 / (number of pairs) per grid point
+  };
+}
+
+#endif
@@ -0,0 +1,107 @@
+/****************************************************************************************
+*  pueo/Spectrum.h              Per-channel power spectra
+*
+*  Only available if pueoEvent was built with FFTW (HAVE_FFTW).
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_SPECTRUM_H
+#define PUEO_SPECTRUM_H
+
+#include "Rtypes.h"
+#include "pueo/Conventions.h"
+#include <array>
+
+class TGraph;
+
+namespace pueo
+{
+  class UsefulEvent;
+  class RawHeader;
+  class Dataset;
+
+  //!  pueo::PowerSpectra -- one-sided PSD of every channel of an event
+  /*!
+    Computed with pueo::FFT. All the compute methods take a number of threads to
+    spread the channels over (1 = just this thread, <= 0 = all hardware threads).
+  */
+  class PowerSpectra
+  {
+    public:
+      static constexpr size_t NFREQ = k::NUM_SAMPLES/2+1;
+
+      PowerSpectra() { ; }
+      PowerSpectra(const UsefulEvent & ev, int nthreads = 1) { compute(ev, nthreads); }
+
+      void compute(const UsefulEvent & ev, int nthreads = 1);
+
+      /** Compute out[i] from *events[i] for a batch of n events, with all (event,channel) pairs spread over the threads */
+      static void compute(size_t n, const UsefulEvent * const * events, PowerSpectra * out, int nthreads = 0);
+
+      double freq(size_t chan, size_t i) const { return i * df[chan]; }
+
+      /** Make a graph of a channel's PSD, optionally in dB. Caller owns it. */
+      TGraph * makeGraph(size_t chan, bool dB = false) const;
+
+      std::array<std::array<double, NFREQ>, k::NUM_RF_CHANNELS> psd; ///< mV^2/GHz
+      std::array<double, k::NUM_RF_CHANNELS> df; ///< GHz
+  };
+
+
+  //!  pueo::AverageSpectrum -- running average of the power spectra of min-bias events
+  class AverageSpectrum
+  {
+    public:
+      static constexpr size_t NFREQ = PowerSpectra::NFREQ;
+
+      AverageSpectrum() { reset(); }
+
+      /** Min-bias means not RF triggered (i.e. soft, PPS or external triggers) */
+      static bool isMinBias(const RawHeader & h);
+
+      /** Add an event if it's min-bias. Returns true if it was added. */
+      bool add(const UsefulEvent & ev, const RawHeader & h, int nthreads = 1);
+
+      /** Add already-computed spectra unconditionally */
+      void add(const PowerSpectra & ps);
+
+      /** Add all the min-bias events in the current run of a Dataset (or the first max_events of them).
+       *  Leaves the dataset on its last entry. Returns the number added. */
+      Long64_t addRun(Dataset & d, int nthreads = 0, Long64_t max_events = -1);
+
+      void reset();
+
+      Long64_t getN() const { return N; }
+      double freq(size_t chan, size_t i) const { return i * df[chan]; }
+      double getAverage(size_t chan, size_t i) const { return N ? sum[chan][i] / N : 0; }
+      void getAverage(size_t chan, double * out) const;
+
+      /** Make a graph of a channel's average PSD, optionally in dB. Caller owns it. */
+      TGraph * makeGraph(size_t chan, bool dB = false) const;
+
+    private:
+      Long64_t N;
+      std::array<std::array<double, NFREQ>, k::NUM_RF_CHANNELS> sum;
+      std::array<double, k::NUM_RF_CHANNELS> df;
+  };
+}
+
+#endif
@@ -0,0 +1,182 @@
+/****************************************************************************************
+*  pueo/TriggerBits.h              Decoding L2 masks into phi-sector bitsets
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  pueoEvent is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  pueoEvent. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_TRIGGER_BITS_H
+#define PUEO_TRIGGER_BITS_H
+
+#include "Rtypes.h"
+#include "pueo/Conventions.h"
+#include <array>
+#include <cstddef>
+
+namespace pueo
+{
+  class RawHeader;
+  namespace daqhsk
+  {
+    class DaqHsk;
+  }
+
+  /** Turning the 24-bit L2 masks (12 L2s per pol, pol 0 in the low bits) into 24-bit phi-sector masks.
+   *
+   * In the returned masks, bit (phi-1) is set for phi sector phi (1-24). Each L2 covers
+   * two phi sectors and each phi sector two L2s, so a phi sector is triggered (or
+   * excluded) if either of its L2s is. Since that's an OR, the expansion of a 12-bit
+   * L2 mask is the OR of the expansions of its two 6-bit halves, so each mapping is
+   * two lookups in 64-entry tables built at compile time.
+   */
+  namespace triggerbits
+  {
+    constexpr int NUM_L2_PER_POL = 12;
+
+    /** Header L2Mask: the (pol-local) L2 bits making up each phi sector (index 0 unused) */
+    constexpr int pol0_to_bits[25][2] = {
+      { -1, -1 }, // Index 0 (Unused)
+      {5, 11}, {5, 11}, // phis 1, 2
+      {4, 5},  {4, 5},  // phis 3, 4
+      {3, 4},  {3, 4},  // phis 5, 6
+      {2, 3},  {2, 3},  // phis 7, 8
+      {1, 2},  {1, 2},  // phis 9, 10
+      {0, 1},  {0, 1},  // phis 11, 12
+      {6, 0},  {6, 0},  // phis 13, 14
+      {7, 6},  {7, 6},  // phis 15, 16
+      {8, 7},  {8, 7},  // phis 17, 18
+      {9, 8},  {9, 8},  // phis 19, 20
+      {10, 9}, {10, 9}, // phis 21, 22
+      {11, 10},{11, 10} // phis 23, 24
+    };
+
+    /** Header L2Mask: the global L2 bits (12-23) making up each phi sector for pol 1 (index 0 unused) */
+    constexpr int pol1_to_bits[25][2] = {
+      { -1, -1 },  // Index 0 (Unused)
+      {23, 17}, {23, 17}, // phis 1, 2
+      {22, 23}, {22, 23}, // phis 3, 4
+      {21, 22}, {21, 22}, // phis 5, 6
+      {20, 21}, {20, 21}, // phis 7, 8
+      {19, 20}, {19, 20}, // phis 9, 10
+      {18, 19}, {18, 19}, // phis 11, 12
+      {12, 18}, {12, 18}, // phis 13, 14
+      {13, 12}, {13, 12}, // phis 15, 16
+      {14, 13}, {14, 13}, // phis 17, 18
+      {15, 14}, {15, 14}, // phis 19, 20
+      {16, 15}, {16, 15}, // phis 21, 22
+      {17, 16}, {17, 16}  // phis 23, 24
+    };
+
+    /** DaqHsk l2_enable_mask: the (pol-local) L2 bits making up each phi sector, same for both pols (index 0 unused) */
+    constexpr int phi_to_bits[25][2] = {
+      { -1, -1 }, // Index 0 (Unused placeholder)
+      {11, 0}, {11, 0}, // phis 1, 2
+      {0, 1},  {0, 1},  // phis 3, 4
+      {1, 2},  {1, 2},  // phis 5, 6
+      {2, 3},  {2, 3},  // phis 7, 8
+      {3, 4},  {3, 4},  // phis 9, 10
+      {4, 5},  {4, 5},  // phis 11, 12
+      {5, 6},  {5, 6},  // phis 13, 14
+      {6, 7},  {6, 7},  // phis 15, 16
+      {7, 8},  {7, 8},  // phis 17, 18
+      {8, 9},  {8, 9},  // phis 19, 20
+      {9, 10}, {9, 10}, // phis 21, 22
+      {10, 11},{10, 11} // phis 23, 24
+    };
+
+    namespace detail
+    {
+      typedef std::array<UInt_t, 64> Lut;
+
+      /** The phi mask for a 6-bit chunk (bits 6*half to 6*half+5) of a pol-local L2 mask */
+      constexpr Lut makeLut(const int (&table)[25][2], int bit_offset, int half)
+      {
+        Lut lut = {};
+        for (int chunk = 0; chunk < 64; chunk++)
+        {
+          UInt_t phis = 0;
+          for (int phi = 1; phi <= 24; phi++)
+          {
+            for (int j = 0; j < 2; j++)
+            {
+              int bit = table[phi][j] - bit_offset - 6 * half;
+              if (bit >= 0 && bit < 6 && ((chunk >> bit) & 1)) phis |= 1u << (phi-1);
+            }
+          }
+          lut[chunk] = phis;
+        }
+        return lut;
+      }
+
+      // [pol][half]
+      constexpr Lut triggered_lut[2][2] = {
+        { makeLut(pol0_to_bits, 0, 0), makeLut(pol0_to_bits, 0, 1) },
+        { makeLut(pol1_to_bits, 12, 0), makeLut(pol1_to_bits, 12, 1) }
+      };
+      constexpr Lut excluded_lut[2] = { makeLut(phi_to_bits, 0, 0), makeLut(phi_to_bits, 0, 1) };
+
+      constexpr UInt_t expand(const Lut * lut, UInt_t l2)
+      {
+        return lut[0][l2 & 0x3f] | lut[1][(l2 >> 6) & 0x3f];
+      }
+    }
+
+    /** Phi sectors (bit phi-1) triggered in pol (0 or 1) according to a header's L2Mask */
+    constexpr UInt_t triggeredPhis(UInt_t L2Mask, int pol)
+    {
+      return detail::expand(detail::triggered_lut[pol & 1], L2Mask >> (NUM_L2_PER_POL * (pol & 1)));
+    }
+
+    /** Phi sectors (bit phi-1) excluded in pol (0 or 1) according to a daqhsk l2_enable_mask (a 0 bit means excluded) */
+    constexpr UInt_t excludedPhis(UInt_t l2_enable_mask, int pol)
+    {
+      return detail::expand(detail::excluded_lut, ~l2_enable_mask >> (NUM_L2_PER_POL * (pol & 1)));
+    }
+
+    /** Both pols at once: out[0] is pol 0, out[1] is pol 1 */
+    inline void triggeredPhis(UInt_t L2Mask, UInt_t out[2])
+    {
+      out[0] = triggeredPhis(L2Mask, 0);
+      out[1] = triggeredPhis(L2Mask, 1);
+    }
+
+    inline void excludedPhis(UInt_t l2_enable_mask, UInt_t out[2])
+    {
+      out[0] = excludedPhis(l2_enable_mask, 0);
+      out[1] = excludedPhis(l2_enable_mask, 1);
+    }
+
+    /** Bulk versions. out needs room for 2n values, out[2*i + pol]. */
+    void triggeredPhis(const UInt_t * L2Masks, size_t n, UInt_t * out);
+    void triggeredPhis(const RawHeader * headers, size_t n, UInt_t * out);
+    void triggeredPhis(const RawHeader * const * headers, size_t n, UInt_t * out);
+    void excludedPhis(const UInt_t * l2_enable_masks, size_t n, UInt_t * out);
+    void excludedPhis(const daqhsk::DaqHsk * const * hsks, size_t n, UInt_t * out);
+
+    /** Bulk triggered-and-not-excluded, for matching arrays of headers and daqhsk (null daqhsk means nothing excluded) */
+    void usablePhis(const RawHeader * const * headers, const daqhsk::DaqHsk * const * hsks, size_t n, UInt_t * out);
+
+    static_assert(triggeredPhis(1u << 5, 0) == 0x3 + (0x3 << 2), "L2 bit 5 of pol 0 is phis 1-4");
+    static_assert(triggeredPhis(1u << 12, 1) == (0x3u << 12) + (0x3u << 14), "L2 bit 12 of pol 1 is phis 13-16");
+    static_assert(excludedPhis(0xffffff, 0) == 0 && excludedPhis(0xffffff, 1) == 0, "all enabled means none excluded");
+    static_assert(excludedPhis(0, 1) == 0xffffff, "none enabled means all excluded");
+  }
+}
+
+#endif
@@ -51,6 +51,10 @@ namespace pueo
       TGraph *makeGraph(ring::ring_t ring, int phi, pol::pol_t pol) const; 
       TGraph *makeGraph(int surf, int chan) const; 
 
+      /** Refresh an existing graph in place with a channel's waveform (no allocation if the size already matches). 
+       *  Name and title are left alone. See EventGraphs for doing all channels at once. */
+      void fillGraph(size_t chanIndex, TGraph * g) const; 
+
       std::array< std::array<double, pueo::k::NUM_SAMPLES>, pueo::k::NUM_RF_CHANNELS> volts;
       std::array<double, k::NUM_RF_CHANNELS> t0;
       std::array<double, k::NUM_RF_CHANNELS> dt; 